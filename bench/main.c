@@ -40,7 +40,7 @@ static struct automaton *createAutomaton(void) {
     }
 
     struct list *list = createList(10);
-    struct automaton *automaton = createAutomaton_BFS(trie, list);
+    struct automaton *automaton = createAutomaton_BFS(trie, list, false);
 
     trieOptions_free(options);
     trie_free(trie);
@@ -64,6 +64,15 @@ func main() {
 			panic(err)
 		}
 
+		if 0 < mode&ac_dat_client.SearchModeCount {
+			count, err := c.Count(zeroTime)
+			if err != nil {
+				panic(err)
+			}
+			fmt.Println("count:", count)
+			continue
+		}
+
 		occurrence, err := c.Occurrence(mode, zeroTime)
 		if err != nil {
 			panic(err)
@@ -12,10 +12,15 @@ import (
 type SearchMode uint8
 
 const (
-	SearchModeFirst    = 0b00000001
-	SearchModeExact    = 0b00000010
-	SearchModeNeedle   = 0b00000100
-	SearchModeUserData = 0b00001000
+	SearchModeFirst           = 0b00000001
+	SearchModeExact           = 0b00000010
+	SearchModeNeedle          = 0b00000100
+	SearchModeUserData        = 0b00001000
+	SearchModeLeftmostLongest = 0b00010000
+	SearchModeLeftmostFirst   = 0b00100000
+	SearchModeWholeWord       = 0b01000000
+	SearchModeCount           = 0b10000000
+	SearchModeExists          = 0b10000001
 
 	UserDataSizeTypeSize = 4
 )
@@ -121,6 +126,18 @@ func (c *client) Occurrence(mode SearchMode, timeout time.Time) (firstOccurrence
 	return
 }
 
+func (c *client) Count(timeout time.Time) (count int32, err error) {
+	defer errHandler(&err)
+
+	if !timeout.IsZero() {
+		try(0, c.connection.SetReadDeadline(timeout))
+	}
+
+	c.read(4, &count)
+
+	return
+}
+
 func (c *client) read(length int32, output any) {
 	data := make([]byte, length)
 	c.readBytes(length, data)
@@ -66,7 +66,7 @@ int main(void) {
     tailBuilder_free(tailBuilder);
 
     struct list *list = createList(10);
-    struct automaton *automaton = createAutomaton_BFS(trie, list);
+    struct automaton *automaton = createAutomaton_BFS(trie, list, false);
 
     automaton_print(automaton);
     tail_print(tail);
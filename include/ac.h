@@ -7,14 +7,24 @@
 
 
 enum searchMode {
-    SEARCH_MODE_FIRST     = 0b00000001,
-    SEARCH_MODE_EXACT     = 0b00000010,
-    SEARCH_MODE_NEEDLE    = 0b00000100,
-    SEARCH_MODE_USER_DATA = 0b00001000,
+    SEARCH_MODE_FIRST            = 0b00000001,
+    SEARCH_MODE_EXACT            = 0b00000010,
+    SEARCH_MODE_NEEDLE           = 0b00000100,
+    SEARCH_MODE_USER_DATA        = 0b00001000,
+    SEARCH_MODE_LEFTMOST_LONGEST = 0b00010000,
+    SEARCH_MODE_LEFTMOST_FIRST   = 0b00100000,
+    SEARCH_MODE_WHOLE_WORD       = 0b01000000,
+    SEARCH_MODE_COUNT            = 0b10000000,
+    SEARCH_MODE_EXISTS           = 0b10000001, // count stopped at the first occurrence
+    SEARCH_MODE_NEEDLE_REFERENCE = 0b100000100, // needle points to the needle table, it is not freed
 };
 
 struct automaton;
 struct occurrence;
+struct searchState;
+struct searchContext;
+
+typedef _Bool (SearchHandler)(const struct occurrence *occurrence, void *context);
 
 
 size_t automaton_getSize(const struct automaton *automaton);
@@ -25,12 +35,109 @@ struct occurrence *automaton_search(
     const char *needle,
     enum searchMode mode
 );
+struct occurrence *automaton_searchWithLength(
+    const struct automaton *automaton,
+    const struct tail *tail,
+    const struct userDataList *userDataList,
+    const char *text,
+    size_t length,
+    enum searchMode mode
+);
+void automaton_searchEach(
+    const struct automaton *automaton,
+    const struct tail *tail,
+    const struct userDataList *userDataList,
+    const char *text,
+    size_t length,
+    enum searchMode mode,
+    SearchHandler *handler,
+    void *context
+);
+size_t automaton_searchCount(
+    const struct automaton *automaton,
+    const struct tail *tail,
+    const struct userDataList *userDataList,
+    const char *text,
+    size_t length,
+    enum searchMode mode
+);
+_Bool automaton_searchExists(
+    const struct automaton *automaton,
+    const struct tail *tail,
+    const struct userDataList *userDataList,
+    const char *text,
+    size_t length,
+    enum searchMode mode
+);
+struct occurrence *automaton_searchParallel(
+    const struct automaton *automaton,
+    const struct tail *tail,
+    const struct userDataList *userDataList,
+    const char *text,
+    size_t length,
+    enum searchMode mode,
+    int threadCount
+);
+void automaton_searchBatch(
+    const struct automaton *automaton,
+    const struct tail *tail,
+    const struct userDataList *userDataList,
+    const char *const *texts,
+    const size_t *lengths,
+    size_t count,
+    enum searchMode mode,
+    struct occurrence **occurrences
+);
+void automaton_searchBatchEach(
+    const struct automaton *automaton,
+    const struct tail *tail,
+    const struct userDataList *userDataList,
+    const char *const *texts,
+    const size_t *lengths,
+    size_t count,
+    enum searchMode mode,
+    SearchHandler *handler,
+    void *const *contexts
+);
+
+struct searchContext *createSearchContext(size_t blockSize);
+void searchContext_reset(struct searchContext *searchContext);
+void searchContext_free(struct searchContext *searchContext);
+struct occurrence *automaton_searchInContext(
+    const struct automaton *automaton,
+    const struct tail *tail,
+    const struct userDataList *userDataList,
+    const char *text,
+    size_t length,
+    enum searchMode mode,
+    struct searchContext *searchContext
+);
+
+struct searchState *createSearchState(
+    const struct automaton *automaton,
+    const struct tail *tail,
+    const struct userDataList *userDataList,
+    enum searchMode mode
+);
+_Bool searchState_feed(struct searchState *searchState, const char *chunk, size_t length, SearchHandler *handler, void *context);
+_Bool searchState_finish(struct searchState *searchState);
+void searchState_free(struct searchState *searchState);
 
+int32_t occurrence_getState(const struct occurrence *occurrence);
+int32_t occurrence_getNeedleId(const struct occurrence *occurrence);
+struct userData occurrence_getUserData(const struct occurrence *occurrence);
 char *occurrence_getNeedle(const struct occurrence *occurrence);
 int occurrence_getNeedleLength(const struct occurrence *occurrence);
+size_t occurrence_getStart(const struct occurrence *occurrence);
+size_t occurrence_getEnd(const struct occurrence *occurrence);
+size_t occurrence_getCharacterStart(const struct occurrence *occurrence);
+size_t occurrence_getCharacterEnd(const struct occurrence *occurrence);
+struct occurrence *occurrence_getNext(const struct occurrence *occurrence);
 
-struct automaton *createAutomaton_DFS(const struct trie *trie, struct list *list);
-struct automaton *createAutomaton_BFS(const struct trie *trie, struct list *list);
+struct automaton *createAutomaton_DFS(const struct trie *trie, struct list *list, _Bool unfoldTail);
+struct automaton *createAutomaton_BFS(const struct trie *trie, struct list *list, _Bool unfoldTail);
+void automaton_buildTransitionTable(struct automaton *automaton);
+void automaton_buildNeedleTable(struct automaton *automaton, const struct tail *tail);
 
 void occurrence_free(struct occurrence *occurrence);
 void automaton_free(struct automaton *automaton);
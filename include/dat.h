@@ -12,13 +12,27 @@ struct trie;
 
 
 struct trieOptions *createTrieOptions(_Bool useTail, _Bool useUserData, size_t childListInitSize);
+void trieOptions_setByteAlphabet(struct trieOptions *options, _Bool useByteAlphabet);
+void trieOptions_setDenseAlphabet(struct trieOptions *options, _Bool useDenseAlphabet);
+void trieOptions_setCaseFolding(struct trieOptions *options, _Bool useCaseFolding);
+void trieOptions_setTailDeduplication(struct trieOptions *options, _Bool useTailDeduplication);
 void trieOptions_free(struct trieOptions *options);
 
 struct trie *createTrie(struct trieOptions *options, struct tailBuilder *tailBuilder, struct userDataList *userDataList, size_t initialSize);
+struct trie *createTrieFromNeedles(
+    struct trieOptions *options,
+    struct tailBuilder *tailBuilder,
+    struct userDataList *userDataList,
+    size_t initialSize,
+    struct trieNeedle *const *needles,
+    const struct userData *data,
+    size_t count,
+    int32_t *needleIds
+);
 size_t trie_getSize(const struct trie *trie);
 void trie_free(struct trie *trie);
 
-void trie_addNeedle(struct trie *trie, const struct trieNeedle *needle);
-void trie_addNeedleWithData(struct trie *trie, const struct trieNeedle *needle, struct userData data);
+int32_t trie_addNeedle(struct trie *trie, const struct trieNeedle *needle);
+int32_t trie_addNeedleWithData(struct trie *trie, const struct trieNeedle *needle, struct userData data);
 
 #endif
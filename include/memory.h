@@ -0,0 +1,19 @@
+#ifndef __AC_DAT__MEMORY__H__
+#define __AC_DAT__MEMORY__H__
+
+
+// missing callbacks (NULL) are replaced with the default ones, missing aligned allocation uses malloc,
+// free gets blocks of malloc, realloc and aligned allocation, realloc gets only blocks of malloc and realloc
+// (aligned blocks are resized by aligned allocation and copied)
+struct allocator {
+    void *(*malloc)(size_t size, void *userData);
+    void *(*realloc)(void *pointer, size_t size, void *userData);
+    void (*free)(void *pointer, void *userData);
+    void *(*alignedAlloc)(size_t alignment, size_t size, void *userData);
+    void *userData;
+};
+
+
+void memory_setAllocator(const struct allocator *allocator);
+
+#endif
@@ -7,7 +7,7 @@ struct tailBuilder;
 
 
 struct tailBuilder *createTailBuilder(size_t size);
-struct tail *createTail(size_t size);
+struct tail *createTail(size_t size, size_t length);
 struct tail *createTailFromBuilder(const struct tailBuilder *tailBuilder);
 
 void tail_free(struct tail *tail);
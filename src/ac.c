@@ -1,18 +1,62 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "definitions.h"
 #include "ac.h"
 #include "list.h"
 #include "dat.h"
 #include "tail.h"
 #include "memory.h"
+#include "thread.h"
 #include "user_data.h"
 
-static inline Occurrence *createOccurrence(UserData userData, FoundNeedle needle);
-static Automaton *createAutomatonFromTrie(const Trie *trie, List *list);
+// search kernels specialized (by constant flags of the inlined automaton_search_ac) for each combination
+// of tail, FIRST mode and transition table, so the hot loop tests none of them
+#define AUTOMATON_SEARCH_KERNELS(KERNEL) \
+    KERNEL(0, 0, 0) KERNEL(0, 0, 1) KERNEL(0, 1, 0) KERNEL(0, 1, 1) \
+    KERNEL(1, 0, 0) KERNEL(1, 0, 1) KERNEL(1, 1, 0) KERNEL(1, 1, 1)
+
+#define AUTOMATON_SEARCH_KERNEL_NAME(hasTail, isFirst, hasTable) automaton_search_ac_ ## hasTail ## isFirst ## hasTable
+#define AUTOMATON_SEARCH_KERNEL_INDEX(hasTail, isFirst, hasTable) ((hasTail) << 2 | (isFirst) << 1 | (hasTable))
+
+#define AUTOMATON_SEARCH_KERNEL_DECLARE(hasTail, isFirst, hasTable) \
+    static SearchKernel AUTOMATON_SEARCH_KERNEL_NAME(hasTail, isFirst, hasTable);
+
+#define AUTOMATON_SEARCH_KERNEL_DEFINE(hasTail, isFirst, hasTable) \
+    static void AUTOMATON_SEARCH_KERNEL_NAME(hasTail, isFirst, hasTable)( \
+            const Automaton *automaton, \
+            const Tail *tail, \
+            const UserDataList *userDataList, \
+            const Needle *text, \
+            const size_t length, \
+            const SearchMode mode, \
+            SearchHandler *handler, \
+            void *context \
+    ) { \
+        automaton_search_ac(automaton, tail, userDataList, text, length, mode, handler, context, hasTail, isFirst, hasTable); \
+    }
+
+#define AUTOMATON_SEARCH_KERNEL_ENTRY(hasTail, isFirst, hasTable) \
+    [AUTOMATON_SEARCH_KERNEL_INDEX(hasTail, isFirst, hasTable)] = AUTOMATON_SEARCH_KERNEL_NAME(hasTail, isFirst, hasTable),
+
+
+static inline Occurrence *createOccurrence(const Occurrence *found);
+static TrieIndex automaton_findLastFilled(const Trie *trie);
+static inline AutomatonIndex automaton_unfoldedState(AutomatonIndex next, AutomatonTransition transition);
+static AutomatonIndex automaton_getUnfoldedSize(const Trie *trie, TrieIndex lastFilled);
+static AutomatonIndex automaton_appendState(Automaton *automaton, AutomatonIndex parent, AutomatonTransition transition, AutomatonIndex *next, AutomatonIndex *children);
+static AutomatonIndex *automaton_unfoldTails(Automaton *automaton, const Trie *trie);
+static Automaton *createAutomatonFromTrie(const Trie *trie, List *list, bool unfoldTail);
 static AutomatonIndex createState(AutomatonTransition transition, AutomatonIndex base);
-static Automaton *buildAutomaton(const Trie *trie, List *list, TrieIndex (*obtainNode)(List *list));
+static void automaton_linkState(Automaton *automaton, List *list, AutomatonIndex check, AutomatonTransition transition);
+static Automaton *buildAutomaton(const Trie *trie, List *list, TrieIndex (*obtainNode)(List *list), bool unfoldTail);
 static AutomatonIndex automaton_step(const Automaton *automaton, AutomatonIndex state, AutomatonTransition transition);
+static inline AutomatonIndex automaton_transition(const Automaton *automaton, AutomatonIndex state, Character character);
+static force_inline AutomatonIndex automaton_transitionKernel(const Automaton *automaton, AutomatonIndex state, Character character, bool hasTable);
+static void automaton_buildTransitionClasses(Automaton *automaton);
+static AutomatonIndex *automaton_sortByDepth(const Automaton *automaton, AutomatonIndex *count);
+static void automaton_buildPrefilter(Automaton *automaton);
+static void automaton_buildPrefilter_folded(Automaton *automaton);
 static inline void automaton_copyCell(Automaton *automaton, const Trie *trie, TrieIndex trieIndex);
 static void automaton_setBase(Automaton *automaton, AutomatonIndex index, AutomatonIndex value);
 static void automaton_setCheck(Automaton *automaton, AutomatonIndex index, AutomatonIndex value);
@@ -22,15 +66,53 @@ static AutomatonIndex automaton_getBase(const Automaton *automaton, AutomatonInd
 static AutomatonIndex automaton_getCheck(const Automaton *automaton, AutomatonIndex index);
 static AutomatonIndex automaton_getFail(const Automaton *automaton, AutomatonIndex index);
 static AutomatonIndex automaton_getOutput(const Automaton *automaton, AutomatonIndex index);
-static FoundNeedle automaton_returnNeedle(const Automaton *automaton, const Tail *tail, AutomatonIndex state);
+static inline Needle *automaton_allocateNeedle(int size, Arena *arena);
+static FoundNeedle automaton_returnNeedle(const Automaton *automaton, const Tail *tail, AutomatonIndex state, Arena *arena);
+static inline FoundNeedle automaton_referNeedle(const Automaton *automaton, NeedleId needleId);
+static inline bool automaton_isNeedleReference(SearchMode mode);
+static inline bool automaton_isNeedleEnd(const Automaton *automaton, AutomatonIndex state);
 static inline void automaton_returnNeedle_trieFill(const Automaton *automaton, Needle *needle, int trieLength, AutomatonIndex state);
-static inline void automaton_returnNeedle_tailFill(Needle *needle, int trieLength, TailCell tailCell);
-static inline int automaton_returnNeedle_trieLength(const Automaton *automaton, AutomatonIndex state);
-static inline int automaton_returnNeedle_tailLength(TailCell tailCell);
-static Occurrence *automaton_createOccurrence(const Automaton *automaton, const Tail *tail, const UserDataList *userDataList, AutomatonIndex state, SearchMode mode);
-static inline Occurrence *automaton_search_exact(const Automaton *automaton, const Tail *tail, const UserDataList *userDataList, const Needle *needle, SearchMode mode);
-static inline Occurrence *automaton_search_ac(const Automaton *automaton, const Tail *tail, const UserDataList *userDataList, const Needle *needle, SearchMode mode);
-static bool isTail(const Tail *tail, const Needle *needle, bool isExact, int needleIndex, TailIndex tailIndex);
+static inline void automaton_returnNeedle_tailFill(const Automaton *automaton, Needle *needle, int trieLength, TailCell tailCell);
+static inline NeedleSize automaton_transitionSize(const Automaton *automaton, AutomatonIndex state);
+static inline NeedleSize automaton_returnNeedle_trieSize(const Automaton *automaton, AutomatonIndex state);
+static inline bool automaton_isTailText(const Automaton *automaton);
+static inline NeedleSize automaton_returnNeedle_tailSize(const Automaton *automaton, TailCell tailCell);
+static inline Character automaton_getSymbol(const Automaton *automaton, Character character);
+static inline Character automaton_getCharacter(const Automaton *automaton, Character symbol);
+static inline TextCharacter automaton_readCharacter(const Automaton *automaton, const Needle *text, size_t length, size_t index);
+static inline NeedleSize automaton_characterSize(const Automaton *automaton, Character symbol);
+static inline void automaton_writeCharacter(const Automaton *automaton, Character symbol, int length, Needle *needle, int start);
+static inline AutomatonIndex automaton_getNeedleState(const Automaton *automaton, AutomatonIndex state);
+static inline AutomatonIndex automaton_getDataState(const Automaton *automaton, AutomatonIndex state);
+static void automaton_fillOccurrence(Occurrence *occurrence, const Automaton *automaton, const Tail *tail, const UserDataList *userDataList, AutomatonIndex state, size_t index, size_t characterIndex, SearchMode mode);
+static bool occurrenceList_append(const Occurrence *occurrence, void *context);
+static bool occurrenceCount_increment(const Occurrence *occurrence, void *context);
+static bool searchContext_append(const Occurrence *occurrence, void *context);
+static void occurrenceList_free(Occurrence *occurrence, SearchMode mode);
+static bool searchChunk_append(const Occurrence *occurrence, void *context);
+static void searchChunk_run(void *userData);
+static size_t automaton_getReportIndex(const Automaton *automaton, const Tail *tail, const Occurrence *occurrence);
+static Occurrence *automaton_mergeChunks(const Automaton *automaton, const Tail *tail, SearchChunk *chunks, size_t count);
+static inline void automaton_search_exact(const Automaton *automaton, const Tail *tail, const UserDataList *userDataList, const Needle *text, size_t length, SearchMode mode, SearchHandler *handler, void *context);
+static force_inline bool automaton_search_acOutputs(const Automaton *automaton, const Tail *tail, const UserDataList *userDataList, const Needle *text, size_t length, SearchMode mode, SearchHandler *handler, void *context, AutomatonIndex state, size_t index, size_t characterIndex, bool hasTail, bool isFirst);
+static force_inline void automaton_search_ac(const Automaton *automaton, const Tail *tail, const UserDataList *userDataList, const Needle *text, size_t length, SearchMode mode, SearchHandler *handler, void *context, bool hasTail, bool isFirst, bool hasTable);
+static inline void automaton_skipToStart(const Automaton *automaton, const Needle *text, size_t length, size_t *index, size_t *characterIndex);
+static inline void searchLane_start(SearchLane *lane, const Needle *text, size_t length, void *context);
+static inline TextCharacter searchLane_readCharacter(const Automaton *automaton, const SearchLane *lane);
+static inline void automaton_prefetchTransition(const Automaton *automaton, SearchLane *lane, bool useTable);
+static inline bool automaton_searchLane_exact(const Automaton *automaton, const Tail *tail, const UserDataList *userDataList, SearchMode mode, SearchLane *lane, SearchHandler *handler);
+static inline bool automaton_searchLane_ac(const Automaton *automaton, const Tail *tail, const UserDataList *userDataList, SearchMode mode, SearchLane *lane, SearchHandler *handler);
+static inline bool leftmostMatch_isBetter(const LeftmostMatch *candidate, const LeftmostMatch *pending, bool isLongest);
+static inline void automaton_search_leftmostOutputs(const Automaton *automaton, const Tail *tail, const Needle *text, size_t length, SearchMode mode, AutomatonIndex state, size_t index, size_t characterIndex, size_t minStart, LeftmostMatch *pending);
+static void automaton_search_leftmost(const Automaton *automaton, const Tail *tail, const UserDataList *userDataList, const Needle *text, size_t length, SearchMode mode, SearchHandler *handler, void *context);
+static bool isTail(const Automaton *automaton, const Tail *tail, const Needle *text, size_t length, bool isExact, size_t textIndex, TailIndex tailIndex);
+static bool automaton_isWholeWord(const Automaton *automaton, const Tail *tail, const Needle *text, size_t length, AutomatonIndex state, size_t index);
+static void searchState_reset(SearchState *searchState);
+static bool searchState_report(SearchState *searchState, AutomatonIndex state, size_t index, size_t characterIndex, SearchHandler *handler, void *context);
+static void searchState_pushTail(SearchState *searchState, AutomatonIndex state);
+static bool searchState_advanceTails(SearchState *searchState, Character character, SearchHandler *handler, void *context);
+static bool searchState_character(SearchState *searchState, TextCharacter character, SearchHandler *handler, void *context);
+AUTOMATON_SEARCH_KERNELS(AUTOMATON_SEARCH_KERNEL_DECLARE)
 
 
 static void automaton_setBase(Automaton *automaton, const AutomatonIndex index, const AutomatonIndex value) {
@@ -42,11 +124,19 @@ static void automaton_setCheck(Automaton *automaton, const AutomatonIndex index,
 }
 
 static void automaton_setFail(Automaton *automaton, const AutomatonIndex index, const AutomatonIndex value) {
+#ifdef AUTOMATON_SPLIT_CELLS
+    automaton->fails[index] = value;
+#else
     automaton->cells[index].fail = value;
+#endif
 }
 
 static void automaton_setOutput(Automaton *automaton, const AutomatonIndex index, const AutomatonIndex value) {
+#ifdef AUTOMATON_SPLIT_CELLS
+    automaton->outputs[index] = value;
+#else
     automaton->cells[index].output = value;
+#endif
 }
 
 
@@ -59,11 +149,19 @@ static AutomatonIndex automaton_getCheck(const Automaton *automaton, const Autom
 }
 
 static AutomatonIndex automaton_getFail(const Automaton *automaton, const AutomatonIndex index) {
+#ifdef AUTOMATON_SPLIT_CELLS
+    return automaton->fails[index] ?: 1;
+#else
     return automaton->cells[index].fail ?: 1;
+#endif
 }
 
 static AutomatonIndex automaton_getOutput(const Automaton *automaton, const AutomatonIndex index) {
+#ifdef AUTOMATON_SPLIT_CELLS
+    return automaton->outputs[index];
+#else
     return automaton->cells[index].output;
+#endif
 }
 
 
@@ -79,36 +177,62 @@ static AutomatonIndex createState(const AutomatonTransition transition, const Au
 static inline void automaton_copyCell(Automaton *automaton, const Trie *trie, const TrieIndex trieIndex) {
     automaton_setBase(automaton, (AutomatonIndex)trieIndex, (AutomatonIndex)trie_getBase(trie, trieIndex));
     automaton_setCheck(automaton, (AutomatonIndex)trieIndex, (AutomatonIndex)trie_getCheck(trie, trieIndex));
+    automaton->needleIds[trieIndex] = trie->needleIds[trieIndex];
 }
 
 static AutomatonIndex automaton_step(const Automaton *automaton, AutomatonIndex state, const AutomatonTransition transition) {
-    AutomatonIndex nextState, base;
+    for (;;) {
+        const AutomatonIndex base = automaton_getBase(automaton, state);
+        if (likely(base > 0)) {
+            const AutomatonIndex nextState = createState(transition, base);
+            if (automaton_getCheck(automaton, nextState) == state) {
+                return nextState;
+            }
+        }
 
-    base = automaton_getBase(automaton, state);
-    if (base > 0) {
-        nextState = createState(transition, base);
-        while (nextState > 0 && automaton_getCheck(automaton, nextState) != state && state != TRIE_POOL_START) {
-            state = automaton_getFail(automaton, state);
-            nextState = createState(transition, automaton_getBase(automaton, state));
+        if (state == TRIE_POOL_START) {
+            return state;
         }
-    }
 
-    base = automaton_getBase(automaton, state);
-    if (base < 0) {
-        return state;
+        state = automaton_getFail(automaton, state);
     }
+}
 
-    nextState = base + transition;
-    if (automaton_getCheck(automaton, nextState) == state) {
-        state = nextState;
+static force_inline AutomatonIndex automaton_transitionKernel(
+        const Automaton *automaton,
+        const AutomatonIndex state,
+        const Character character,
+        const bool hasTable
+) {
+    if (hasTable && likely(character < TRANSITION_TABLE_ALPHABET)) {
+        return automaton->transitions[(size_t)state * automaton->transitionClassCount + automaton->transitionClasses[character]];
     }
 
-    return state;
+    return automaton_step(automaton, state, (AutomatonTransition)character);
+}
+
+static inline AutomatonIndex automaton_transition(const Automaton *automaton, const AutomatonIndex state, const Character character) {
+    return automaton_transitionKernel(automaton, state, character, automaton->transitions != NULL);
 }
 
 void automaton_free(Automaton *automaton) {
-    free(automaton->cells);
-    free(automaton);
+    safeFree(automaton->transitions);
+    if (automaton->alphabet != NULL) {
+        alphabet_free(automaton->alphabet);
+    }
+    if (automaton->needleTable != NULL) {
+        needleTable_free(automaton->needleTable);
+    }
+#ifdef AUTOMATON_SPLIT_CELLS
+    safeFree(automaton->fails);
+    safeFree(automaton->outputs);
+#endif
+    safeFree(automaton->depths);
+    safeFree(automaton->byteDepths);
+    safeFree(automaton->characterDepths);
+    safeFree(automaton->needleIds);
+    safeFree(automaton->cells);
+    safeFree(automaton);
     automaton = NULL;
 }
 
@@ -119,18 +243,401 @@ Automaton *createAutomaton(const AutomatonIndex initialSize) {
 
     automaton->size = initialSize;
     automaton->cells = safeAlloc(cellsSize, "AC automaton cells");
+#ifdef AUTOMATON_SPLIT_CELLS
+    const size_t indexesSize = initialSize * sizeof(AutomatonIndex);
+
+    automaton->fails = safeAlloc(indexesSize, "AC automaton fails");
+    automaton->outputs = safeAlloc(indexesSize, "AC automaton outputs");
+    resetMemory(automaton->fails, indexesSize);
+    resetMemory(automaton->outputs, indexesSize);
+#endif
+    automaton->depths = safeAlloc(initialSize * sizeof(AutomatonIndex), "AC automaton depths");
+    automaton->byteDepths = safeAlloc(initialSize * sizeof(AutomatonIndex), "AC automaton byte depths");
+    automaton->characterDepths = safeAlloc(initialSize * sizeof(AutomatonIndex), "AC automaton character depths");
+    automaton->needleIds = safeAlloc(initialSize * sizeof(NeedleId), "AC automaton needle IDs");
+    resetMemory(automaton->depths, initialSize * sizeof(AutomatonIndex));
+    resetMemory(automaton->byteDepths, initialSize * sizeof(AutomatonIndex));
+    resetMemory(automaton->characterDepths, initialSize * sizeof(AutomatonIndex));
+    for (AutomatonIndex i = 0; i < initialSize; i++) {
+        automaton->needleIds[i] = NEEDLE_ID_NONE;
+    }
+    automaton->useByteAlphabet = false;
+    automaton->useCaseFolding = false;
+    automaton->maxNeedleLength = 0;
+    automaton->unfoldedStart = initialSize;
+    automaton->alphabet = NULL;
+    automaton->needleTable = NULL;
+    automaton->transitions = NULL;
+    automaton->transitionClassCount = 0;
+    prefilter_reset(&automaton->prefilter);
     resetMemory(automaton->cells, cellsSize);
+    resetMemory(automaton->transitionClasses, sizeof(automaton->transitionClasses));
 
     return automaton;
 }
 
-static Automaton *createAutomatonFromTrie(const Trie *trie, List *list) {
+AutomatonIndex *createTransitionTable(const AutomatonIndex size, const int classCount) {
+    return safeAlloc((size_t)size * classCount * sizeof(AutomatonIndex), "AC automaton transitions");
+}
+
+// class 0 is shared by all characters without any transition, they always lead to the root
+static void automaton_buildTransitionClasses(Automaton *automaton) {
+    resetMemory(automaton->transitionClasses, sizeof(automaton->transitionClasses));
+    automaton->transitionClassCount = 1;
+
+    for (AutomatonIndex state = TRIE_POOL_START + 1; state < automaton->size; state++) {
+        const AutomatonIndex check = automaton_getCheck(automaton, state);
+        if (check <= 0) {
+            continue;
+        }
+
+        const AutomatonTransition transition = state - automaton_getBase(automaton, check);
+        if (transition < TRANSITION_TABLE_ALPHABET && transition != END_OF_TEXT && !automaton->transitionClasses[transition]) {
+            automaton->transitionClasses[transition] = automaton->transitionClassCount++;
+        }
+    }
+}
+
+// states are sorted by depth (counting sort), the root goes first and a fail state always before its state
+static AutomatonIndex *automaton_sortByDepth(const Automaton *automaton, AutomatonIndex *count) {
+    AutomatonIndex maxDepth = 0;
+    for (AutomatonIndex state = TRIE_POOL_START + 1; state < automaton->size; state++) {
+        if (automaton_getCheck(automaton, state) > 0 && automaton->depths[state] > maxDepth) {
+            maxDepth = automaton->depths[state];
+        }
+    }
+
+    AutomatonIndex *starts = safeAlloc(((size_t)maxDepth + 2) * sizeof(AutomatonIndex), "AC automaton depth starts");
+    resetMemory(starts, ((size_t)maxDepth + 2) * sizeof(AutomatonIndex));
+    starts[1] = 1;
+    for (AutomatonIndex state = TRIE_POOL_START + 1; state < automaton->size; state++) {
+        if (automaton_getCheck(automaton, state) > 0) {
+            starts[automaton->depths[state] + 1]++;
+        }
+    }
+    for (AutomatonIndex depth = 1; depth <= maxDepth + 1; depth++) {
+        starts[depth] += starts[depth - 1];
+    }
+
+    AutomatonIndex *states = safeAlloc((size_t)starts[maxDepth + 1] * sizeof(AutomatonIndex), "AC automaton states by depth");
+    states[starts[0]++] = TRIE_POOL_START;
+    for (AutomatonIndex state = TRIE_POOL_START + 1; state < automaton->size; state++) {
+        if (automaton_getCheck(automaton, state) > 0) {
+            states[starts[automaton->depths[state]]++] = state;
+        }
+    }
+
+    *count = starts[maxDepth];
+    safeFree(starts);
+
+    return states;
+}
+
+// rows are filled in order of depth, a missing transition is copied from the row of the fail state,
+// which is already complete, so no fail links are followed
+void automaton_buildTransitionTable(Automaton *automaton) {
+    automaton_buildTransitionClasses(automaton);
+
+    const int classCount = automaton->transitionClassCount;
+    AutomatonIndex *transitions = createTransitionTable(automaton->size, classCount);
+    for (size_t i = 0; i < (size_t)automaton->size * classCount; i++) {
+        transitions[i] = TRIE_POOL_START;
+    }
+
+    AutomatonTransition classCharacters[TRANSITION_TABLE_ALPHABET];
+    for (AutomatonTransition character = 0; character < TRANSITION_TABLE_ALPHABET; character++) {
+        classCharacters[automaton->transitionClasses[character]] = character;
+    }
+
+    AutomatonIndex count = 0;
+    AutomatonIndex *states = automaton_sortByDepth(automaton, &count);
+    for (AutomatonIndex i = 0; i < count; i++) {
+        const AutomatonIndex state = states[i];
+        const AutomatonIndex base = automaton_getBase(automaton, state);
+        const AutomatonIndex fail = state == TRIE_POOL_START ? 0 : automaton_getFail(automaton, state);
+        const AutomatonIndex *failRow = fail > 0 ? transitions + (size_t)fail * classCount : NULL;
+        AutomatonIndex *row = transitions + (size_t)state * classCount;
+
+        for (int transitionClass = 1; transitionClass < classCount; transitionClass++) {
+            const AutomatonIndex child = base > 0 ? base + classCharacters[transitionClass] : 0;
+            if (child > 0 && child < automaton->size && automaton_getCheck(automaton, child) == state) {
+                row[transitionClass] = child;
+            } else if (failRow) {
+                row[transitionClass] = failRow[transitionClass];
+            }
+        }
+    }
+    safeFree(states);
+
+    safeFree(automaton->transitions);
+    automaton->transitions = transitions;
+}
+
+// needle ends at the end of text state or at the state with tail
+static inline bool automaton_isNeedleEnd(const Automaton *automaton, const AutomatonIndex state) {
+    const AutomatonIndex check = automaton_getCheck(automaton, state);
+    if (check <= 0) {
+        return false;
+    }
+
+    return automaton_getBase(automaton, state) < 0 || state - automaton_getBase(automaton, check) == END_OF_TEXT;
+}
+
+// each needle is reconstructed once and kept by its ID, occurrences in NEEDLE_REFERENCE mode point to it,
+// automaton with case folding has the table with dictionary forms already
+void automaton_buildNeedleTable(Automaton *automaton, const Tail *tail) {
+    if (automaton->needleTable != NULL) {
+        return;
+    }
+
+    NeedleId count = 0;
+    for (AutomatonIndex state = TRIE_POOL_START + 1; state < automaton->size; state++) {
+        if (automaton_isNeedleEnd(automaton, state)) {
+            if (unlikely(automaton->needleIds[state] == NEEDLE_ID_NONE)) {
+                error("needle table requires needle IDs");
+            }
+            if (automaton->needleIds[state] >= count) {
+                count = automaton->needleIds[state] + 1;
+            }
+        }
+    }
+
+    AutomatonIndex *states = safeAlloc((size_t)(count ?: 1) * sizeof(AutomatonIndex), "AC needle table states");
+    resetMemory(states, (size_t)count * sizeof(AutomatonIndex));
+    for (AutomatonIndex state = TRIE_POOL_START + 1; state < automaton->size; state++) {
+        if (automaton_isNeedleEnd(automaton, state)) {
+            states[automaton->needleIds[state]] = state;
+        }
+    }
+
+    // IDs of duplicates in older files have no state, they are kept empty
+    NeedleTable *needleTable = createNeedleTable(NEEDLE_TABLE_INIT_SIZE, count);
+    for (NeedleId needleId = 0; needleId < count; needleId++) {
+        if (states[needleId]) {
+            const FoundNeedle needle = automaton_returnNeedle(automaton, tail, states[needleId], NULL);
+            needleTable_addBytes(needleTable, needle.needle, (NeedleTableOffset)needle.length);
+            safeFree(needle.needle);
+        } else {
+            needleTable_addBytes(needleTable, NULL, 0);
+        }
+    }
+    safeFree(states);
+
+    automaton->needleTable = needleTable;
+}
+
+// text characters folded to a root transition can start a needle as well
+static void automaton_buildPrefilter_folded(Automaton *automaton) {
+    const AutomatonIndex rootBase = automaton_getBase(automaton, TRIE_POOL_START);
+    const Character last = automaton->useByteAlphabet ? 0x7F : UNICODE_FOLD_LAST;
+    char bytes[4];
+
+    for (Character character = 0; character <= last; character++) {
+        const Character folded = automaton->useByteAlphabet ? asciiFold(character) : unicodeFold(character);
+        if (folded == character) {
+            continue;
+        }
+
+        const Character symbol = automaton->alphabet ? alphabet_getSymbol(automaton->alphabet, folded) : folded;
+        const AutomatonIndex state = rootBase + symbol;
+        if (symbol == ALPHABET_UNKNOWN_SYMBOL || state >= automaton->size || automaton_getCheck(automaton, state) != TRIE_POOL_START) {
+            continue;
+        }
+
+        unicodeToUtf8(character, unicodeLength(character), bytes, 0);
+        prefilter_add(&automaton->prefilter, (unsigned char)bytes[0]);
+    }
+}
+
+// first bytes of all needles are the root transitions, an empty needle matches everywhere and disables the prefilter
+static void automaton_buildPrefilter(Automaton *automaton) {
+    Prefilter *prefilter = &automaton->prefilter;
+    const AutomatonIndex rootBase = automaton_getBase(automaton, TRIE_POOL_START);
+    bool hasEmptyNeedle = false;
+    char bytes[4];
+
+    prefilter_reset(prefilter);
+
+    for (AutomatonIndex state = TRIE_POOL_START + 1; state < automaton->size; state++) {
+        if (automaton_getCheck(automaton, state) != TRIE_POOL_START) {
+            continue;
+        }
+
+        const AutomatonTransition transition = state - rootBase;
+        if (transition == END_OF_TEXT) {
+            hasEmptyNeedle = true;
+            continue;
+        }
+
+        const Character character = automaton_getCharacter(automaton, transition);
+        if (automaton->useByteAlphabet) {
+            prefilter_add(prefilter, (unsigned char)character);
+        } else {
+            unicodeToUtf8(character, unicodeLength(character), bytes, 0);
+            prefilter_add(prefilter, (unsigned char)bytes[0]);
+        }
+    }
+
+    if (automaton->useCaseFolding) {
+        automaton_buildPrefilter_folded(automaton);
+    }
+
+    prefilter_build(prefilter);
+    prefilter->isEnabled = prefilter->isEnabled && !hasEmptyNeedle;
+}
+
+// depth is the count of transitions from the root, byte and character depths are the length of the path
+// in the text (the end of text adds nothing), states are walked up to the first one with known depth
+void automaton_buildDepths(Automaton *automaton) {
+    AutomatonIndex *depths = automaton->depths;
+    resetMemory(depths, (size_t)automaton->size * sizeof(AutomatonIndex));
+    resetMemory(automaton->byteDepths, (size_t)automaton->size * sizeof(AutomatonIndex));
+    resetMemory(automaton->characterDepths, (size_t)automaton->size * sizeof(AutomatonIndex));
+
+    for (AutomatonIndex state = TRIE_POOL_START + 1; state < automaton->size; state++) {
+        if (depths[state] || automaton_getCheck(automaton, state) <= 0) {
+            continue;
+        }
+
+        AutomatonIndex depth = 0, current = state;
+        NeedleSize size = {0, 0};
+        while (current != TRIE_POOL_START && !depths[current]) {
+            const NeedleSize characterSize = automaton_transitionSize(automaton, current);
+            depth++;
+            size.length += characterSize.length;
+            size.characters += characterSize.characters;
+            current = automaton_getCheck(automaton, current);
+        }
+        depth += depths[current];
+        size.length += automaton->byteDepths[current];
+        size.characters += automaton->characterDepths[current];
+
+        for (current = state; current != TRIE_POOL_START && !depths[current]; current = automaton_getCheck(automaton, current)) {
+            const NeedleSize characterSize = automaton_transitionSize(automaton, current);
+            depths[current] = depth--;
+            automaton->byteDepths[current] = (AutomatonIndex)size.length;
+            automaton->characterDepths[current] = (AutomatonIndex)size.characters;
+            size.length -= characterSize.length;
+            size.characters -= characterSize.characters;
+        }
+    }
+}
+
+// files stored without the maximal needle length get it from the longest needle in the automaton, depths must be built
+void automaton_buildMaxNeedleLength(Automaton *automaton, const Tail *tail) {
+    automaton->maxNeedleLength = 0;
+
+    for (AutomatonIndex state = TRIE_POOL_START + 1; state < automaton->size; state++) {
+        if (automaton_getCheck(automaton, state) <= 0) {
+            continue;
+        }
+
+        const AutomatonIndex needleState = automaton_getNeedleState(automaton, state);
+        const AutomatonIndex base = automaton_getBase(automaton, state);
+        if (needleState == state && base >= 0) {
+            continue;
+        }
+
+        size_t length = automaton_returnNeedle_trieSize(automaton, needleState).length;
+        if (base < 0) {
+            length += automaton_returnNeedle_tailSize(automaton, tail_getCell(tail, -base)).length;
+        }
+        if (length > automaton->maxNeedleLength) {
+            automaton->maxNeedleLength = length;
+        }
+    }
+}
+
+static TrieIndex automaton_findLastFilled(const Trie *trie) {
     TrieIndex lastFilled = -trie_getBase(trie, 0);
     while (likely(trie_getCheck(trie, lastFilled) <= 0)) {
         lastFilled--;
     }
 
-    Automaton *automaton = createAutomaton(lastFilled + 1);
+    return lastFilled;
+}
+
+// unfolded state must be placed at least behind its transition, so the base of its parent is positive
+static inline AutomatonIndex automaton_unfoldedState(const AutomatonIndex next, const AutomatonTransition transition) {
+    return next > transition ? next : transition + 1;
+}
+
+static AutomatonIndex automaton_getUnfoldedSize(const Trie *trie, const TrieIndex lastFilled) {
+    AutomatonIndex size = lastFilled + 1;
+
+    for (TrieIndex state = TRIE_POOL_START + 1; state <= lastFilled; state++) {
+        const TrieBase base = trie_getBase(trie, state);
+        if (trie_getCheck(trie, state) <= 0 || base >= 0) {
+            continue;
+        }
+
+        const TailBuilderCell cell = trie->tailBuilder->cells[-base];
+        for (TailCharIndex i = 0; i < cell.length; i++) {
+            size = automaton_unfoldedState(size, (AutomatonTransition)cell.chars[i]) + 1;
+        }
+        size = automaton_unfoldedState(size, END_OF_TEXT) + 1;
+    }
+
+    return size;
+}
+
+static AutomatonIndex automaton_appendState(
+        Automaton *automaton,
+        const AutomatonIndex parent,
+        const AutomatonTransition transition,
+        AutomatonIndex *next,
+        AutomatonIndex *children
+) {
+    const AutomatonIndex state = automaton_unfoldedState(*next, transition);
+    *next = state + 1;
+
+    automaton_setBase(automaton, parent, state - transition);
+    automaton_setCheck(automaton, state, parent);
+    children[parent] = state;
+
+    return state;
+}
+
+// each tail becomes a chain of states behind the trie cells, ended by the end of text state,
+// the only child of each state in the chain is returned, so fail and output functions can be built
+static AutomatonIndex *automaton_unfoldTails(Automaton *automaton, const Trie *trie) {
+    AutomatonIndex *children = safeAlloc((size_t)automaton->size * sizeof(AutomatonIndex), "AC automaton unfolded children");
+    resetMemory(children, (size_t)automaton->size * sizeof(AutomatonIndex));
+
+    AutomatonIndex next = automaton->unfoldedStart;
+    for (AutomatonIndex state = TRIE_POOL_START + 1; state < automaton->unfoldedStart; state++) {
+        const TrieBase base = trie_getBase(trie, state);
+        if (trie_getCheck(trie, state) <= 0 || base >= 0) {
+            continue;
+        }
+
+        const TailBuilderCell cell = trie->tailBuilder->cells[-base];
+        AutomatonIndex current = state;
+        for (TailCharIndex i = 0; i < cell.length; i++) {
+            current = automaton_appendState(automaton, current, (AutomatonTransition)cell.chars[i], &next, children);
+        }
+
+        const AutomatonIndex endState = automaton_appendState(automaton, current, END_OF_TEXT, &next, children);
+        automaton->needleIds[endState] = automaton->needleIds[state];
+    }
+
+    return children;
+}
+
+static Automaton *createAutomatonFromTrie(const Trie *trie, List *list, const bool unfoldTail) {
+    const TrieIndex lastFilled = automaton_findLastFilled(trie);
+
+    if (unlikely(unfoldTail && trie->options->useTail && NULL == trie->tailBuilder)) {
+        error("tail builder is required for unfolding tail");
+    }
+
+    Automaton *automaton = createAutomaton(unfoldTail && trie->options->useTail ? automaton_getUnfoldedSize(trie, lastFilled) : lastFilled + 1);
+    automaton->unfoldedStart = lastFilled + 1;
+    automaton->useByteAlphabet = trie->options->useByteAlphabet;
+    automaton->useCaseFolding = trie->options->useCaseFolding;
+    automaton->maxNeedleLength = trie->maxNeedleLength;
+    automaton->alphabet = trie->alphabet ? alphabet_clone(trie->alphabet) : NULL;
+    automaton->needleTable = trie->needleTable ? needleTable_clone(trie->needleTable) : NULL;
 
     automaton_copyCell(automaton, trie, TRIE_POOL_START);
 
@@ -146,14 +653,42 @@ static Automaton *createAutomatonFromTrie(const Trie *trie, List *list) {
         }
     }
 
+    automaton_buildPrefilter(automaton);
+
     return automaton;
 }
 
-static Automaton *buildAutomaton(const Trie *trie, List *list, TrieIndex (*obtainNode)(List *list)) {
-    Automaton *automaton = createAutomatonFromTrie(trie, list);
+static void automaton_linkState(Automaton *automaton, List *list, const AutomatonIndex check, const AutomatonTransition transition) {
+    if (transition == END_OF_TEXT) {
+        return;
+    }
+
+    const AutomatonIndex state = createState(transition, automaton_getBase(automaton, check));
+    const AutomatonIndex next = automaton_step(automaton, automaton_getFail(automaton, check), transition);
+    const AutomatonIndex nextBase = automaton_getBase(automaton, next);
+
+    automaton_setFail(automaton, state, next);
+
+    if (nextBase > 0 && automaton_getCheck(automaton, nextBase + END_OF_TEXT) == next) {
+        automaton_setOutput(automaton, state, next);
+    } else {
+        automaton_setOutput(automaton, state, automaton_getOutput(automaton, next));
+    }
+
+    list_push(list, state);
+}
+
+static Automaton *buildAutomaton(const Trie *trie, List *list, TrieIndex (*obtainNode)(List *list), const bool unfoldTail) {
+    Automaton *automaton = createAutomatonFromTrie(trie, list, unfoldTail);
+    AutomatonIndex *children = automaton->size > automaton->unfoldedStart ? automaton_unfoldTails(automaton, trie) : NULL;
 
     while (likely(!list_isEmpty(list))) {
         const AutomatonIndex check = obtainNode(list);
+        if (children && children[check]) {
+            automaton_linkState(automaton, list, check, children[check] - automaton_getBase(automaton, check));
+            continue;
+        }
+
         const List *checkChildren = trie_getChildren(trie, check);
         if (checkChildren == NULL) {
             continue;
@@ -164,49 +699,35 @@ static Automaton *buildAutomaton(const Trie *trie, List *list, TrieIndex (*obtai
             const AutomatonTransition transition = list_getValue(checkChildren, listIndex);
             listIndex = list_iterate(checkChildren, listIndex);
 
-            if (transition == END_OF_TEXT) {
-                continue;
-            }
-
-            const AutomatonIndex state = createState(transition, automaton_getBase(automaton, check));
-            const AutomatonIndex next = automaton_step(automaton, automaton_getFail(automaton, check), transition);
-            const AutomatonIndex nextBase = automaton_getBase(automaton, next);
-
-            automaton_setFail(automaton, state, next);
-
-            if (nextBase > 0 && automaton_getCheck(automaton, nextBase + END_OF_TEXT) == next) {
-                automaton_setOutput(automaton, state, next);
-            } else {
-                automaton_setOutput(automaton, state, automaton_getOutput(automaton, next));
-            }
-
-            list_push(list, state);
+            automaton_linkState(automaton, list, check, transition);
         }
     }
 
+    safeFree(children);
+    automaton_buildDepths(automaton);
+
     return automaton;
 }
 
-Automaton *createAutomaton_DFS(const Trie *trie, List *list) {
-    return buildAutomaton(trie, list, list_pop);
+Automaton *createAutomaton_DFS(const Trie *trie, List *list, const bool unfoldTail) {
+    return buildAutomaton(trie, list, list_pop, unfoldTail);
 }
 
-Automaton *createAutomaton_BFS(const Trie *trie, List *list) {
-    return buildAutomaton(trie, list, list_shift);
+Automaton *createAutomaton_BFS(const Trie *trie, List *list, const bool unfoldTail) {
+    return buildAutomaton(trie, list, list_shift, unfoldTail);
 }
 
 
-static inline Occurrence *createOccurrence(UserData userData, FoundNeedle needle) {
+static inline Occurrence *createOccurrence(const Occurrence *found) {
     Occurrence *occurrence = safeAlloc(sizeof(Occurrence), "occurrence");
-    occurrence->userData = userData;
+    *occurrence = *found;
     occurrence->next = NULL;
-    occurrence->needle = needle;
 
     return occurrence;
 }
 
 void occurrence_free(Occurrence *occurrence) {
-    free(occurrence);
+    safeFree(occurrence);
     occurrence = NULL;
 }
 
@@ -218,38 +739,157 @@ int occurrence_getNeedleLength(const Occurrence *occurrence) {
     return occurrence->needle.length;
 }
 
+AutomatonIndex occurrence_getState(const Occurrence *occurrence) {
+    return occurrence->state;
+}
+
+// ID returned by trie_addNeedle, it doesn't change with the layout of the automaton
+NeedleId occurrence_getNeedleId(const Occurrence *occurrence) {
+    return occurrence->needleId;
+}
+
+UserData occurrence_getUserData(const Occurrence *occurrence) {
+    return occurrence->userData;
+}
+
+size_t occurrence_getStart(const Occurrence *occurrence) {
+    return occurrence->offset.start;
+}
+
+size_t occurrence_getEnd(const Occurrence *occurrence) {
+    return occurrence->offset.end;
+}
+
+size_t occurrence_getCharacterStart(const Occurrence *occurrence) {
+    return occurrence->characterOffset.start;
+}
+
+size_t occurrence_getCharacterEnd(const Occurrence *occurrence) {
+    return occurrence->characterOffset.end;
+}
+
+Occurrence *occurrence_getNext(const Occurrence *occurrence) {
+    return occurrence->next;
+}
 
-static inline int automaton_returnNeedle_trieLength(const Automaton *automaton, const AutomatonIndex state) {
-    int length;
-    int trieLength = 0;
-    AutomatonIndex current = state, prev = automaton_getCheck(automaton, state);
 
-    while (prev > 0) {
-        length = unicodeLength(current - automaton_getBase(automaton, prev));
-        trieLength += length;
-        current = prev;
-        prev = automaton_getCheck(automaton, current);
+// with dense alphabet the automaton transitions are symbols, characters of text are mapped to them
+static inline Character automaton_getSymbol(const Automaton *automaton, Character character) {
+    if (automaton->useCaseFolding) {
+        character = automaton->useByteAlphabet ? asciiFold(character) : unicodeFold(character);
     }
 
-    return trieLength;
+    return automaton->alphabet ? alphabet_getSymbol(automaton->alphabet, character) : character;
 }
 
-static inline int automaton_returnNeedle_tailLength(const TailCell tailCell) {
-    int tailLength = 0;
+static inline Character automaton_getCharacter(const Automaton *automaton, const Character symbol) {
+    return automaton->alphabet ? alphabet_getCharacter(automaton->alphabet, symbol) : symbol;
+}
+
+static inline TextCharacter automaton_readCharacter(
+        const Automaton *automaton,
+        const Needle *text,
+        const size_t length,
+        const size_t index
+) {
+    const unsigned char byte = (unsigned char)text[index];
+    if (automaton->useByteAlphabet) {
+        return (TextCharacter) {automaton_getSymbol(automaton, byte), 1, !isUtf8Continuation(byte)};
+    }
+
+    const int u8Length = utf8Length(byte);
+    if (unlikely(!u8Length || index + u8Length > length)) {
+        return (TextCharacter) {0, 0, 0};
+    }
+
+    const Character character = utf8ToUnicode(text + index, 0, u8Length);
+    if (unlikely((!character && u8Length > 1) || !unicodeIsValid(character, u8Length))) {
+        return (TextCharacter) {0, 0, 0};
+    }
+
+    return (TextCharacter) {automaton_getSymbol(automaton, character), u8Length, 1};
+}
+
+static inline NeedleSize automaton_characterSize(const Automaton *automaton, const Character symbol) {
+    const Character character = automaton_getCharacter(automaton, symbol);
+
+    return automaton->useByteAlphabet
+        ? (NeedleSize) {1, !isUtf8Continuation((unsigned char)character)}
+        : (NeedleSize) {unicodeLength(character), 1};
+}
+
+static inline void automaton_writeCharacter(
+        const Automaton *automaton,
+        const Character symbol,
+        const int length,
+        Needle *needle,
+        const int start
+) {
+    const Character character = automaton_getCharacter(automaton, symbol);
+
+    if (automaton->useByteAlphabet) {
+        needle[start] = (char)character;
+    } else {
+        unicodeToUtf8(character, length, needle, start);
+    }
+}
+
+// states of unfolded tail have no user data, it is kept by the tail state where the unfolding starts
+static inline AutomatonIndex automaton_getDataState(const Automaton *automaton, AutomatonIndex state) {
+    while (state >= automaton->unfoldedStart) {
+        state = automaton_getCheck(automaton, state);
+    }
+
+    return state;
+}
+
+static inline AutomatonIndex automaton_getNeedleState(const Automaton *automaton, const AutomatonIndex state) {
+    const AutomatonIndex check = automaton_getCheck(automaton, state);
+    return state - automaton_getBase(automaton, check) == END_OF_TEXT ? check : state;
+}
+
+static inline NeedleSize automaton_transitionSize(const Automaton *automaton, const AutomatonIndex state) {
+    const AutomatonTransition transition = state - automaton_getBase(automaton, automaton_getCheck(automaton, state));
+    return transition == END_OF_TEXT ? (NeedleSize) {0, 0} : automaton_characterSize(automaton, transition);
+}
+
+static inline NeedleSize automaton_returnNeedle_trieSize(const Automaton *automaton, const AutomatonIndex state) {
+    return (NeedleSize) {(size_t)automaton->byteDepths[state], (size_t)automaton->characterDepths[state]};
+}
+
+// without mapped symbols the tail bytes are the bytes of the matched text (folding keeps the length)
+static inline bool automaton_isTailText(const Automaton *automaton) {
+    return NULL == automaton->alphabet && !automaton->useByteAlphabet;
+}
+
+static inline NeedleSize automaton_returnNeedle_tailSize(const Automaton *automaton, const TailCell tailCell) {
+    if (automaton_isTailText(automaton)) {
+        return (NeedleSize) {tailCell.length, utf8CountCharacters(tailCell.bytes, tailCell.length)};
+    }
+
+    NeedleSize size = {0, 0};
 
-    for (TailCharIndex i = 0; i < tailCell.length; i++) {
-        tailLength += unicodeLength(tailCell.chars[i]);
+    for (TailCharIndex i = 0; i < tailCell.length;) {
+        const NeedleSize characterSize = automaton_characterSize(automaton, tailCell_readCharacter(tailCell, &i));
+        size.length += characterSize.length;
+        size.characters += characterSize.characters;
     }
 
-    return tailLength;
+    return size;
 }
 
-static inline void automaton_returnNeedle_tailFill(Needle *needle, const int trieLength, const TailCell tailCell) {
+static inline void automaton_returnNeedle_tailFill(const Automaton *automaton, Needle *needle, const int trieLength, const TailCell tailCell) {
+    if (automaton_isTailText(automaton)) {
+        memcpy(needle + trieLength, tailCell.bytes, tailCell.length);
+        return;
+    }
+
     int start = trieLength;
 
-    for (TailCharIndex i = 0; i < tailCell.length; i++) {
-        int length = unicodeLength(tailCell.chars[i]);
-        unicodeToUtf8(tailCell.chars[i], length, needle, start);
+    for (TailCharIndex i = 0; i < tailCell.length;) {
+        const Character character = tailCell_readCharacter(tailCell, &i);
+        int length = (int)automaton_characterSize(automaton, character).length;
+        automaton_writeCharacter(automaton, character, length, needle, start);
         start += length;
     }
 }
@@ -262,32 +902,48 @@ static inline void automaton_returnNeedle_trieFill(const Automaton *automaton, N
         checkBase = automaton_getBase(automaton, check);
 
         const Character character = actual - checkBase;
-        int length = unicodeLength(character);
+        int length = (int)automaton_characterSize(automaton, character).length;
 
-        unicodeToUtf8(character, length, needle, start - length);
+        automaton_writeCharacter(automaton, character, length, needle, start - length);
 
         start -= length;
         actual = check;
     }
 }
 
-static FoundNeedle automaton_returnNeedle(const Automaton *automaton, const Tail *tail, const AutomatonIndex state) {
+static inline Needle *automaton_allocateNeedle(const int size, Arena *arena) {
+    return arena ? arena_alloc(arena, (size_t)size) : safeAlloc(sizeof(char) * size, "AC needle characters");
+}
+
+// with the needle table (case folding) the needle is returned in its dictionary form, not the folded one,
+// with the arena of the search context the needle is not allocated on its own
+static FoundNeedle automaton_returnNeedle(const Automaton *automaton, const Tail *tail, AutomatonIndex state, Arena *arena) {
+    if (automaton->needleTable) {
+        const NeedleId needleId = automaton->needleIds[state];
+        const int size = (int)needleTable_getLength(automaton->needleTable, needleId);
+        Needle *needle = automaton_allocateNeedle(size, arena);
+        memcpy(needle, needleTable_getNeedle(automaton->needleTable, needleId), size);
+
+        return (FoundNeedle) { needle, size };
+    }
+
+    state = automaton_getNeedleState(automaton, state);
     const AutomatonIndex stateBase = automaton_getBase(automaton, state);
 
-    int trieLength = automaton_returnNeedle_trieLength(automaton, state);
+    const int trieLength = (int)automaton_returnNeedle_trieSize(automaton, state).length;
 
     int tailLength = 0;
     TailCell tailCell;
     if (0 > stateBase) {
         tailCell = tail_getCell(tail, -stateBase);
-        tailLength = automaton_returnNeedle_tailLength(tailCell);
+        tailLength = (int)automaton_returnNeedle_tailSize(automaton, tailCell).length;
     }
 
     const int size = trieLength + tailLength;
-    Needle *needle = safeAlloc(sizeof(char) * size, "AC needle characters");
+    Needle *needle = automaton_allocateNeedle(size, arena);
 
     if (0 > stateBase) {
-        automaton_returnNeedle_tailFill(needle, trieLength, tailCell);
+        automaton_returnNeedle_tailFill(automaton, needle, trieLength, tailCell);
     }
 
     automaton_returnNeedle_trieFill(automaton, needle, trieLength, state);
@@ -296,132 +952,857 @@ static FoundNeedle automaton_returnNeedle(const Automaton *automaton, const Tail
 }
 
 
-static bool isTail(const Tail *tail, const Needle *needle, bool isExact, const int needleIndex, const TailIndex tailIndex) {
+static inline FoundNeedle automaton_referNeedle(const Automaton *automaton, const NeedleId needleId) {
+    if (unlikely(automaton->needleTable == NULL)) {
+        error("needle reference requires needle table");
+    }
+
+    return (FoundNeedle) {
+        (Needle *)needleTable_getNeedle(automaton->needleTable, needleId),
+        (int)needleTable_getLength(automaton->needleTable, needleId),
+    };
+}
+
+static inline bool automaton_isNeedleReference(const SearchMode mode) {
+    return (mode & SEARCH_MODE_NEEDLE_REFERENCE) == SEARCH_MODE_NEEDLE_REFERENCE;
+}
+
+static bool isTail(
+        const Automaton *automaton,
+        const Tail *tail,
+        const Needle *text,
+        const size_t length,
+        const bool isExact,
+        const size_t textIndex,
+        const TailIndex tailIndex
+) {
     const TailCell tailCell = tail_getCell(tail, tailIndex);
 
-    Character character;
+    // folded text has to be read character by character
+    if (automaton_isTailText(automaton) && !automaton->useCaseFolding) {
+        return tailCell.length <= length - textIndex
+            && 0 == memcmp(text + textIndex, tailCell.bytes, tailCell.length)
+            && (!isExact || textIndex + tailCell.length == length);
+    }
+
     TailCharIndex t = 0;
-    int u8Length, index = needleIndex;
+    size_t index = textIndex;
 
-    while (needle[index] != '\0' && t < tailCell.length) {
-        u8Length = utf8Length(needle[index]);
-        character = utf8ToUnicode(needle, index, u8Length);
+    while (index < length && t < tailCell.length) {
+        const TextCharacter character = automaton_readCharacter(automaton, text, length, index);
+        if (unlikely(!character.length)) {
+            return false;
+        }
 
-        if (character != tailCell.chars[t] && unlikely(0 > character)) {
+        if (character.character != tailCell_readCharacter(tailCell, &t) || unlikely(0 > character.character)) {
             return false;
         }
 
-        t++;
-        index += u8Length;
+        index += character.length;
     }
 
-    return t == tailCell.length && (!isExact || needle[index] == '\0');
+    return t == tailCell.length && (!isExact || index == length);
 }
 
-static Occurrence *automaton_createOccurrence(
+// characters next to the match must not be word characters, the start of the match in the text
+// is found by walking back over as many characters as is the depth of the needle state
+static bool automaton_isWholeWord(
         const Automaton *automaton,
         const Tail *tail,
-        const UserDataList *userDataList,
+        const Needle *text,
+        const size_t length,
         const AutomatonIndex state,
-        const SearchMode mode
+        const size_t index
 ) {
-    FoundNeedle foundNeedle = {0};
-    if (mode & SEARCH_MODE_NEEDLE) {
-        foundNeedle = automaton_returnNeedle(automaton, tail, state);
+    const AutomatonIndex base = automaton_getBase(automaton, state);
+    const size_t end = base < 0
+        ? index + automaton_returnNeedle_tailSize(automaton, tail_getCell(tail, -base)).length
+        : index;
+
+    if (isWordCharacter(utf8CharacterAt(text, length, end))) {
+        return false;
     }
 
-    UserData userData = {0};
-    if (mode & SEARCH_MODE_USER_DATA) {
-        userData = userDataList_get(userDataList, state);
+    size_t start = index;
+    if (automaton->useByteAlphabet) {
+        start -= automaton->depths[state];
+    } else {
+        for (AutomatonIndex depth = automaton->depths[state]; depth > 0; depth--) {
+            do {
+                start--;
+            } while (start > 0 && isUtf8Continuation((unsigned char)text[start]));
+        }
     }
 
-    return createOccurrence(userData, foundNeedle);
+    return !isWordCharacter(utf8CharacterBefore(text, start));
 }
 
-static inline Occurrence *automaton_search_exact(
+static void automaton_fillOccurrence(
+        Occurrence *occurrence,
         const Automaton *automaton,
         const Tail *tail,
         const UserDataList *userDataList,
-        const Needle *needle,
+        const AutomatonIndex state,
+        const size_t index,
+        const size_t characterIndex,
         const SearchMode mode
 ) {
-    AutomatonIndex check = TRIE_POOL_START;
+    occurrence->next = NULL;
+    occurrence->state = state;
+    occurrence->needleId = automaton->needleIds[state];
+    occurrence->needle = (FoundNeedle) {0};
+    occurrence->userData = (UserData) {0};
+
+    // counting needs no offsets
+    if (mode & SEARCH_MODE_COUNT) {
+        occurrence->offset = occurrence->characterOffset = (FoundOffset) {0, 0};
+        return;
+    }
 
-    int index = 0;
-    while (needle[index] != '\0') {
-        const int u8Length = utf8Length(needle[index]);
-        Character character = utf8ToUnicode(needle, index, u8Length);
-        index += u8Length;
+    const AutomatonIndex needleState = automaton_getNeedleState(automaton, state);
+    const AutomatonIndex needleBase = automaton_getBase(automaton, needleState);
+    const NeedleSize trieSize = automaton_returnNeedle_trieSize(automaton, needleState);
+    const NeedleSize tailSize = needleBase < 0
+        ? automaton_returnNeedle_tailSize(automaton, tail_getCell(tail, -needleBase))
+        : (NeedleSize) {0, 0};
 
-        if (unlikely(0 > character)) {
-            return NULL;
-        }
+    occurrence->offset = (FoundOffset) {index - trieSize.length, index + tailSize.length};
+    occurrence->characterOffset = (FoundOffset) {characterIndex - trieSize.characters, characterIndex + tailSize.characters};
+
+    // reference points into the needle table, otherwise the needle is allocated for the caller (copied from the table if any)
+    if (mode & SEARCH_MODE_NEEDLE) {
+        occurrence->needle = automaton_isNeedleReference(mode)
+            ? automaton_referNeedle(automaton, occurrence->needleId)
+            : automaton_returnNeedle(automaton, tail, state, NULL);
+    }
+
+    if (mode & SEARCH_MODE_USER_DATA) {
+        occurrence->userData = userDataList_get(userDataList, automaton_getDataState(automaton, state));
+    }
+}
+
+static bool occurrenceList_append(const Occurrence *occurrence, void *context) {
+    OccurrenceList *list = (OccurrenceList *)context;
+    Occurrence *copy = createOccurrence(occurrence);
+
+    if (NULL == list->last) {
+        list->first = list->last = copy;
+    } else {
+        list->last = list->last->next = copy;
+    }
+
+    return true;
+}
+
+// occurrences and needles are placed in the arena, the needle is constructed here because the search doesn't know the arena
+static bool searchContext_append(const Occurrence *occurrence, void *context) {
+    SearchContext *searchContext = (SearchContext *)context;
+    Occurrence *copy = arena_alloc(searchContext->arena, sizeof(Occurrence));
+    *copy = *occurrence;
+    copy->next = NULL;
+
+    if (searchContext->hasNeedle) {
+        copy->needle = automaton_returnNeedle(searchContext->automaton, searchContext->tail, occurrence->state, searchContext->arena);
+    }
+
+    if (NULL == searchContext->occurrences.last) {
+        searchContext->occurrences.first = searchContext->occurrences.last = copy;
+    } else {
+        searchContext->occurrences.last = searchContext->occurrences.last->next = copy;
+    }
 
-        const AutomatonIndex state = automaton_getBase(automaton, check) + character;
+    return true;
+}
+
+static bool occurrenceCount_increment(const Occurrence *occurrence, void *context) {
+    (void)occurrence;
+    (*(size_t *)context)++;
+
+    return true;
+}
 
-        if (automaton_getCheck(automaton, state) != check) {
-            return NULL;
+static void occurrenceList_free(Occurrence *occurrence, const SearchMode mode) {
+    while (NULL != occurrence) {
+        Occurrence *next = occurrence->next;
+        if (!automaton_isNeedleReference(mode)) {
+            safeFree(occurrence->needle.needle);
         }
+        occurrence_free(occurrence);
+        occurrence = next;
+    }
+}
+
+static inline void searchLane_start(SearchLane *lane, const Needle *text, const size_t length, void *context) {
+    lane->text = text;
+    lane->length = length;
+    lane->index = 0;
+    lane->characterIndex = 0;
+    lane->state = TRIE_POOL_START;
+    lane->next.length = 0;
+    lane->context = context;
+}
+
+// the character may have been read already by the prefetch
+static inline TextCharacter searchLane_readCharacter(const Automaton *automaton, const SearchLane *lane) {
+    if (lane->next.length && lane->nextIndex == lane->index) {
+        return lane->next;
+    }
+
+    return automaton_readCharacter(automaton, lane->text, lane->length, lane->index);
+}
+
+// the next step of the lane reads the cell (or the transition table entry) its state goes to by the next character,
+// the load runs while other lanes take their steps
+static inline void automaton_prefetchTransition(const Automaton *automaton, SearchLane *lane, const bool useTable) {
+    lane->next = automaton_readCharacter(automaton, lane->text, lane->length, lane->index);
+    lane->nextIndex = lane->index;
+
+    const Character character = lane->next.character;
+    if (unlikely(!lane->next.length || 0 > character)) {
+        return;
+    }
+
+    if (useTable && character < TRANSITION_TABLE_ALPHABET) {
+        prefetch(automaton->transitions + (size_t)lane->state * automaton->transitionClassCount + automaton->transitionClasses[character], 0, 1);
+        return;
+    }
+
+    const AutomatonIndex base = automaton_getBase(automaton, lane->state);
+    if (base > 0 && base < automaton->size - character) {
+        prefetch(automaton->cells + createState((AutomatonTransition)character, base), 0, 1);
+    }
+}
+
+static inline bool automaton_searchLane_exact(
+        const Automaton *automaton,
+        const Tail *tail,
+        const UserDataList *userDataList,
+        const SearchMode mode,
+        SearchLane *lane,
+        SearchHandler *handler
+) {
+    const TextCharacter textCharacter = searchLane_readCharacter(automaton, lane);
+    if (unlikely(!textCharacter.length)) {
+        return false;
+    }
+
+    const Character character = textCharacter.character;
+    lane->index += textCharacter.length;
+    lane->characterIndex += textCharacter.characters;
+
+    if (unlikely(0 > character)) {
+        return false;
+    }
 
+    const AutomatonIndex check = lane->state;
+    const AutomatonIndex state = automaton_getBase(automaton, check) + character;
+
+    if (automaton_getCheck(automaton, state) != check) {
+        return false;
+    }
+
+    const AutomatonIndex base = automaton_getBase(automaton, state);
+    const AutomatonIndex endState = createState(END_OF_TEXT, base);
+
+    if ((base > 0 && automaton_getCheck(automaton, endState) == state && lane->index == lane->length) ||
+        (base < 0 && isTail(automaton, tail, lane->text, lane->length, true, lane->index, -base))
+    ) {
+        Occurrence occurrence;
+        automaton_fillOccurrence(&occurrence, automaton, tail, userDataList, base < 0 ? state : endState, lane->index, lane->characterIndex, mode);
+        handler(&occurrence, lane->context);
+        return false;
+    }
+
+    if (base < 0) {
+        return false;
+    }
+
+    lane->state = state;
+
+    return lane->index < lane->length;
+}
+
+static inline void automaton_search_exact(
+        const Automaton *automaton,
+        const Tail *tail,
+        const UserDataList *userDataList,
+        const Needle *text,
+        const size_t length,
+        const SearchMode mode,
+        SearchHandler *handler,
+        void *context
+) {
+    SearchLane lane;
+    searchLane_start(&lane, text, length, context);
+
+    if (length) {
+        while (automaton_searchLane_exact(automaton, tail, userDataList, mode, &lane, handler));
+    }
+}
+
+static force_inline bool automaton_search_acOutputs(
+        const Automaton *automaton,
+        const Tail *tail,
+        const UserDataList *userDataList,
+        const Needle *text,
+        const size_t length,
+        const SearchMode mode,
+        SearchHandler *handler,
+        void *context,
+        AutomatonIndex state,
+        const size_t index,
+        const size_t characterIndex,
+        const bool hasTail,
+        const bool isFirst
+) {
+    Occurrence occurrence;
+
+    while (state) {
         const AutomatonIndex base = automaton_getBase(automaton, state);
         const AutomatonIndex endState = createState(END_OF_TEXT, base);
 
-        if ((base > 0 && automaton_getCheck(automaton, endState) == state && needle[index] == '\0') ||
-            (base < 0 && isTail(tail, needle, true, index, -base))
+        if ((base > 0 && automaton_getCheck(automaton, endState) == state) ||
+            (hasTail && base < 0 && isTail(automaton, tail, text, length, false, index, -base))
         ) {
-            return automaton_createOccurrence(automaton, tail, userDataList, base < 0 ? state : endState, mode);
+            if (mode & SEARCH_MODE_WHOLE_WORD && !automaton_isWholeWord(automaton, tail, text, length, state, index)) {
+                state = automaton_getOutput(automaton, state);
+                continue;
+            }
+
+            automaton_fillOccurrence(&occurrence, automaton, tail, userDataList, base < 0 ? state : endState, index, characterIndex, mode);
+
+            if (!handler(&occurrence, context) || isFirst) {
+                return false;
+            }
         }
 
-        check = state;
+        state = automaton_getOutput(automaton, state);
     }
 
-    return NULL;
+    return true;
+}
+
+// in the root state any text up to the next possible first byte of a needle can not match, it is skipped
+// without decoding and only its characters are counted, the skip ends before invalid UTF8,
+// so reading the next character stops the search the same way as without skipping
+static inline void automaton_skipToStart(
+        const Automaton *automaton,
+        const Needle *text,
+        const size_t length,
+        size_t *index,
+        size_t *characterIndex
+) {
+    const size_t skip = prefilter_find(&automaton->prefilter, text + *index, length - *index);
+
+    if (automaton->useByteAlphabet) {
+        *characterIndex += utf8CountCharacters(text + *index, skip);
+        *index += skip;
+    } else {
+        const Utf8Decoded checked = utf8Check(text + *index, skip);
+        *characterIndex += checked.characters;
+        *index += checked.length;
+    }
 }
 
-static inline Occurrence *automaton_search_ac(
+static force_inline void automaton_search_ac(
         const Automaton *automaton,
         const Tail *tail,
         const UserDataList *userDataList,
-        const Needle *needle,
-        const SearchMode mode
+        const Needle *text,
+        const size_t length,
+        const SearchMode mode,
+        SearchHandler *handler,
+        void *context,
+        const bool hasTail,
+        const bool isFirst,
+        const bool hasTable
 ) {
     AutomatonIndex state = TRIE_POOL_START;
-    Occurrence *firstOccurrence = NULL, *lastOccurrence = NULL, *occurrence = NULL;
+    size_t index = 0, characterIndex = 0;
+
+    if (automaton->useByteAlphabet || automaton->prefilter.isEnabled) {
+        while (index < length) {
+            if (state == TRIE_POOL_START && automaton->prefilter.isEnabled) {
+                automaton_skipToStart(automaton, text, length, &index, &characterIndex);
+                if (index == length) {
+                    return;
+                }
+            }
+
+            const TextCharacter character = automaton_readCharacter(automaton, text, length, index);
+            if (unlikely(!character.length)) {
+                return;
+            }
 
-    int index = 0;
-    while (needle[index] != '\0') {
-        const int u8Length = utf8Length(needle[index]);
-        Character character = utf8ToUnicode(needle, index, u8Length);
-        index += u8Length;
+            index += character.length;
+            characterIndex += character.characters;
 
-        if (unlikely(0 > character)) {
-            return NULL;
+            state = automaton_transitionKernel(automaton, state, character.character, hasTable);
+            if (!automaton_search_acOutputs(automaton, tail, userDataList, text, length, mode, handler, context, state, index, characterIndex, hasTail, isFirst)) {
+                return;
+            }
         }
+        return;
+    }
 
-        AutomatonIndex nextState = state = automaton_step(automaton, state, (AutomatonTransition)character);
+    Character characters[DECODE_BLOCK_SIZE];
+    while (index < length) {
+        const Utf8Decoded decoded = utf8Decode(text + index, length - index, characters, DECODE_BLOCK_SIZE);
 
-        while (nextState) {
-            const AutomatonIndex base = automaton_getBase(automaton, state);
-            const AutomatonIndex endState = createState(END_OF_TEXT, base);
+        for (size_t i = 0; i < decoded.characters; i++) {
+            index += utf8Length((unsigned char)text[index]);
+            characterIndex++;
 
-            if ((base > 0 && automaton_getCheck(automaton, endState) == state) ||
-                (base < 0 && isTail(tail, needle, false, index, -base))
-            ) {
-                occurrence = automaton_createOccurrence(automaton, tail, userDataList, base < 0 ? state : endState, mode);
+            state = automaton_transitionKernel(automaton, state, automaton_getSymbol(automaton, characters[i]), hasTable);
+            if (!automaton_search_acOutputs(automaton, tail, userDataList, text, length, mode, handler, context, state, index, characterIndex, hasTail, isFirst)) {
+                return;
+            }
+        }
 
-                if (NULL == lastOccurrence) {
-                    firstOccurrence = lastOccurrence = occurrence;
-                    if (mode & SEARCH_MODE_FIRST) goto END;
-                } else {
-                    lastOccurrence->next = occurrence;
-                }
+        if (unlikely(!decoded.isValid || !decoded.characters)) {
+            return;
+        }
+    }
+}
+
+// a candidate starting earlier wins, with the same start the longer one or the one inserted first
+static inline bool leftmostMatch_isBetter(const LeftmostMatch *candidate, const LeftmostMatch *pending, const bool isLongest) {
+    if (!pending->state) {
+        return true;
+    }
+    if (candidate->start != pending->start) {
+        return candidate->start < pending->start;
+    }
+
+    return isLongest ? candidate->end > pending->end : candidate->needleId < pending->needleId;
+}
+
+// start and end of candidates are counted in transitions (characters or bytes of the used alphabet)
+static inline void automaton_search_leftmostOutputs(
+        const Automaton *automaton,
+        const Tail *tail,
+        const Needle *text,
+        const size_t length,
+        const SearchMode mode,
+        AutomatonIndex state,
+        const size_t index,
+        const size_t characterIndex,
+        const size_t minStart,
+        LeftmostMatch *pending
+) {
+    const bool isLongest = mode & SEARCH_MODE_LEFTMOST_LONGEST;
+    const size_t position = automaton->useByteAlphabet ? index : characterIndex;
+
+    while (state) {
+        const AutomatonIndex base = automaton_getBase(automaton, state);
+        const AutomatonIndex endState = createState(END_OF_TEXT, base);
+
+        const bool isMatch = (base > 0 && automaton_getCheck(automaton, endState) == state) ||
+            (tail && base < 0 && isTail(automaton, tail, text, length, false, index, -base));
+
+        if (isMatch && (!(mode & SEARCH_MODE_WHOLE_WORD) || automaton_isWholeWord(automaton, tail, text, length, state, index))) {
+            const AutomatonIndex matchState = base < 0 ? state : endState;
+            const LeftmostMatch candidate = {
+                matchState,
+                index,
+                characterIndex,
+                position - automaton->depths[state],
+                position + (base < 0 ? tailCell_countSymbols(tail_getCell(tail, -base)) : 0),
+                automaton->needleIds[matchState],
+            };
+
+            if (candidate.start >= minStart && leftmostMatch_isBetter(&candidate, pending, isLongest)) {
+                *pending = candidate;
+            }
+        }
+
+        state = automaton_getOutput(automaton, state);
+    }
+}
+
+// the best match found so far is pending until no path in progress can start at or before its start,
+// then it is reported and the search continues from its end, so reported matches do not overlap
+static void automaton_search_leftmost(
+        const Automaton *automaton,
+        const Tail *tail,
+        const UserDataList *userDataList,
+        const Needle *text,
+        const size_t length,
+        const SearchMode mode,
+        SearchHandler *handler,
+        void *context
+) {
+    AutomatonIndex state = TRIE_POOL_START;
+    size_t index = 0, characterIndex = 0, minStart = 0;
+    LeftmostMatch pending = {0};
+    Occurrence occurrence;
+
+    for (;;) {
+        if (!pending.state && state == TRIE_POOL_START && automaton->prefilter.isEnabled) {
+            automaton_skipToStart(automaton, text, length, &index, &characterIndex);
+        }
+
+        // the end of the text (or invalid UTF8) reports the pending match, the rest after it is searched again
+        bool isFinal = index == length;
+        if (!isFinal) {
+            const TextCharacter character = automaton_readCharacter(automaton, text, length, index);
+            isFinal = unlikely(!character.length);
+
+            if (!isFinal) {
+                index += character.length;
+                characterIndex += character.characters;
+
+                state = automaton_transition(automaton, state, character.character);
+                automaton_search_leftmostOutputs(automaton, tail, text, length, mode, state, index, characterIndex, minStart, &pending);
+            }
+        }
+
+        const size_t position = automaton->useByteAlphabet ? index : characterIndex;
+        if (!pending.state) {
+            if (isFinal) {
+                return;
+            }
+            continue;
+        }
+        if (!isFinal && position - automaton->depths[state] <= pending.start) {
+            continue;
+        }
+
+        // the search continues after the match, so its offsets are needed even when counting
+        automaton_fillOccurrence(&occurrence, automaton, tail, userDataList, pending.state, pending.index, pending.characterIndex, mode & ~SEARCH_MODE_COUNT);
+        if (!handler(&occurrence, context) || mode & SEARCH_MODE_FIRST) {
+            return;
+        }
+
+        if (pending.end != position) {
+            index = occurrence.offset.end;
+            characterIndex = occurrence.characterOffset.end;
+            state = TRIE_POOL_START;
+        }
+        minStart = pending.end;
+        pending.state = 0;
+    }
+}
+
+AUTOMATON_SEARCH_KERNELS(AUTOMATON_SEARCH_KERNEL_DEFINE)
+
+static SearchKernel *const automaton_searchKernels[] = {
+    AUTOMATON_SEARCH_KERNELS(AUTOMATON_SEARCH_KERNEL_ENTRY)
+};
+
+static inline bool automaton_searchLane_ac(
+        const Automaton *automaton,
+        const Tail *tail,
+        const UserDataList *userDataList,
+        const SearchMode mode,
+        SearchLane *lane,
+        SearchHandler *handler
+) {
+    if (lane->state == TRIE_POOL_START && automaton->prefilter.isEnabled) {
+        automaton_skipToStart(automaton, lane->text, lane->length, &lane->index, &lane->characterIndex);
+        if (lane->index == lane->length) {
+            return false;
+        }
+    }
+
+    const TextCharacter character = searchLane_readCharacter(automaton, lane);
+    if (unlikely(!character.length)) {
+        return false;
+    }
+
+    lane->index += character.length;
+    lane->characterIndex += character.characters;
+
+    lane->state = automaton_transition(automaton, lane->state, character.character);
+    if (!automaton_search_acOutputs(automaton, tail, userDataList, lane->text, lane->length, mode, handler, lane->context, lane->state, lane->index, lane->characterIndex, tail != NULL, mode & SEARCH_MODE_FIRST)) {
+        return false;
+    }
+
+    return lane->index < lane->length;
+}
+
+// texts are searched by lanes which take one character each in turn, so loads of different lanes overlap
+void automaton_searchBatchEach(
+        const Automaton *automaton,
+        const Tail *tail,
+        const UserDataList *userDataList,
+        const Needle *const *texts,
+        const size_t *lengths,
+        const size_t count,
+        const SearchMode mode,
+        SearchHandler *handler,
+        void *const *contexts
+) {
+    SearchLane lanes[SEARCH_BATCH_LANES];
+    const bool useTable = automaton->transitions && !(mode & SEARCH_MODE_EXACT);
+    size_t next = 0;
+    int active = 0;
+
+    if (mode & (SEARCH_MODE_LEFTMOST_LONGEST | SEARCH_MODE_LEFTMOST_FIRST) && !(mode & SEARCH_MODE_EXACT)) {
+        for (size_t i = 0; i < count; i++) {
+            automaton_search_leftmost(automaton, tail, userDataList, texts[i], lengths[i], mode, handler, contexts[i]);
+        }
+        return;
+    }
+
+    while (active < SEARCH_BATCH_LANES && next < count) {
+        searchLane_start(&lanes[active++], texts[next], lengths[next], contexts[next]);
+        next++;
+    }
+
+    while (active) {
+        for (int l = 0; l < active;) {
+            SearchLane *lane = &lanes[l];
+            const bool isRunning = lane->index < lane->length && (mode & SEARCH_MODE_EXACT
+                ? automaton_searchLane_exact(automaton, tail, userDataList, mode, lane, handler)
+                : automaton_searchLane_ac(automaton, tail, userDataList, mode, lane, handler));
+
+            if (likely(isRunning)) {
+                automaton_prefetchTransition(automaton, lane, useTable);
+                l++;
+            } else if (next < count) {
+                searchLane_start(lane, texts[next], lengths[next], contexts[next]);
+                next++;
+            } else {
+                lanes[l] = lanes[--active];
+            }
+        }
+    }
+}
+
+void automaton_searchBatch(
+        const Automaton *automaton,
+        const Tail *tail,
+        const UserDataList *userDataList,
+        const Needle *const *texts,
+        const size_t *lengths,
+        const size_t count,
+        const SearchMode mode,
+        Occurrence **occurrences
+) {
+    OccurrenceList *lists = safeAlloc(count * sizeof(OccurrenceList), "batch occurrence lists");
+    void **contexts = safeAlloc(count * sizeof(void*), "batch contexts");
+
+    for (size_t i = 0; i < count; i++) {
+        lists[i] = (OccurrenceList) {NULL, NULL};
+        contexts[i] = &lists[i];
+    }
+
+    automaton_searchBatchEach(automaton, tail, userDataList, texts, lengths, count, mode, occurrenceList_append, contexts);
+
+    for (size_t i = 0; i < count; i++) {
+        occurrences[i] = lists[i].first;
+    }
+
+    safeFree(contexts);
+    safeFree(lists);
+}
+
+// offsets are moved to the whole text, character offsets are moved after all chunks count their characters
+static bool searchChunk_append(const Occurrence *occurrence, void *context) {
+    SearchChunk *chunk = (SearchChunk *)context;
+    const size_t start = chunk->start + occurrence->offset.start;
+    const size_t end = chunk->start + occurrence->offset.end;
+
+    // matches starting in the overlap belong to the next chunk, word boundaries are checked in the whole text
+    if (start >= chunk->end || (chunk->mode & SEARCH_MODE_WHOLE_WORD && (
+        isWordCharacter(utf8CharacterBefore(chunk->text, start))
+        || isWordCharacter(utf8CharacterAt(chunk->text, chunk->length, end))
+    ))) {
+        if (!automaton_isNeedleReference(chunk->mode)) {
+            safeFree(occurrence->needle.needle);
+        }
+        return true;
+    }
+
+    occurrenceList_append(occurrence, &chunk->occurrences);
+    chunk->occurrences.last->offset = (FoundOffset) {start, end};
+
+    return !(chunk->mode & SEARCH_MODE_FIRST);
+}
+
+static void searchChunk_run(void *userData) {
+    SearchChunk *chunk = (SearchChunk *)userData;
+    const SearchMode mode = chunk->mode & ~(SEARCH_MODE_FIRST | SEARCH_MODE_WHOLE_WORD);
+
+    chunk->characters = utf8CountCharacters(chunk->text + chunk->start, chunk->end - chunk->start);
+    automaton_searchEach(chunk->automaton, chunk->tail, chunk->userDataList, chunk->text + chunk->start, chunk->searchEnd - chunk->start, mode, searchChunk_append, chunk);
+}
+
+// occurrences are reported in order of the text index where they are found, which is the end of the match
+// except of the tail, which is found at its first character
+static size_t automaton_getReportIndex(const Automaton *automaton, const Tail *tail, const Occurrence *occurrence) {
+    const AutomatonIndex base = automaton_getBase(automaton, occurrence->state);
+    return base < 0
+        ? occurrence->offset.end - automaton_returnNeedle_tailSize(automaton, tail_getCell(tail, -base)).length
+        : occurrence->offset.end;
+}
+
+// chunks overlap, so their lists are merged by report index, an earlier chunk goes first on equality
+static Occurrence *automaton_mergeChunks(const Automaton *automaton, const Tail *tail, SearchChunk *chunks, const size_t count) {
+    OccurrenceList list = {NULL, NULL};
+    size_t *indexes = safeAlloc(count * sizeof(size_t), "parallel search indexes");
+
+    for (size_t i = 0; i < count; i++) {
+        if (chunks[i].occurrences.first) {
+            indexes[i] = automaton_getReportIndex(automaton, tail, chunks[i].occurrences.first);
+        }
+    }
+
+    for (;;) {
+        SearchChunk *next = NULL;
+        size_t nextIndex = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (chunks[i].occurrences.first && (!next || indexes[i] < indexes[nextIndex])) {
+                next = &chunks[i];
+                nextIndex = i;
             }
+        }
+        if (!next) {
+            break;
+        }
+
+        Occurrence *occurrence = next->occurrences.first;
+        next->occurrences.first = occurrence->next;
+        if (next->occurrences.first) {
+            indexes[nextIndex] = automaton_getReportIndex(automaton, tail, next->occurrences.first);
+        }
 
-            nextState = automaton_getOutput(automaton, nextState);
+        occurrence->next = NULL;
+        if (NULL == list.last) {
+            list.first = list.last = occurrence;
+        } else {
+            list.last = list.last->next = occurrence;
         }
     }
 
-    END: return firstOccurrence;
+    safeFree(indexes);
+
+    return list.first;
+}
+
+// text is split at UTF-8 boundaries into chunks searched on own worker pool, each chunk is searched
+// further by the longest needle minus one byte, so matches crossing the split are found
+Occurrence *automaton_searchParallel(
+        const Automaton *automaton,
+        const Tail *tail,
+        const UserDataList *userDataList,
+        const Needle *text,
+        const size_t length,
+        const SearchMode mode,
+        int threadCount
+) {
+    if (unlikely(mode & (SEARCH_MODE_LEFTMOST_LONGEST | SEARCH_MODE_LEFTMOST_FIRST))) {
+        error("leftmost search can not be run in parallel");
+    }
+    if (unlikely(mode & SEARCH_MODE_COUNT)) {
+        error("count search can not be run in parallel");
+    }
+
+    if (threadCount < 1) {
+        threadCount = getAvailableCores();
+    }
+
+    const size_t overlap = automaton->maxNeedleLength ? automaton->maxNeedleLength - 1 : 0;
+    const size_t minChunk = overlap < SEARCH_PARALLEL_MIN_CHUNK ? SEARCH_PARALLEL_MIN_CHUNK : overlap + 1;
+    size_t count = length / minChunk;
+    if (count > (size_t)threadCount) {
+        count = (size_t)threadCount;
+    }
+
+    if (count < 2 || mode & SEARCH_MODE_EXACT) {
+        return automaton_searchWithLength(automaton, tail, userDataList, text, length, mode);
+    }
+
+    SearchChunk *chunks = safeAlloc(count * sizeof(SearchChunk), "parallel search chunks");
+    size_t start = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t end = i + 1 == count ? length : length / count * (i + 1);
+        while (end < length && isUtf8Continuation((unsigned char)text[end])) {
+            end++;
+        }
+
+        chunks[i] = (SearchChunk) {
+            automaton, tail, userDataList, text, length, start, end,
+            end + overlap < length ? end + overlap : length, 0, mode, {NULL, NULL},
+        };
+        start = end;
+    }
+
+    WorkerPool *pool = createWorkerPool((int)count, searchChunk_run);
+    workerPool_start(pool);
+    for (size_t i = 0; i < count; i++) {
+        workerPool_addJob(pool, createJob(&chunks[i]));
+    }
+    workerPool_drain(pool);
+    workerPool_stop(pool);
+    workerPool_join(pool);
+    workerPool_free(pool);
+
+    size_t characters = 0;
+    for (size_t i = 0; i < count; i++) {
+        for (Occurrence *occurrence = chunks[i].occurrences.first; occurrence; occurrence = occurrence->next) {
+            occurrence->characterOffset.start += characters;
+            occurrence->characterOffset.end += characters;
+        }
+        characters += chunks[i].characters;
+    }
+
+    Occurrence *occurrences = automaton_mergeChunks(automaton, tail, chunks, count);
+    safeFree(chunks);
+
+    if (occurrences && mode & SEARCH_MODE_FIRST) {
+        occurrenceList_free(occurrences->next, mode);
+        occurrences->next = NULL;
+    }
+
+    return occurrences;
+}
+
+void automaton_searchEach(
+        const Automaton *automaton,
+        const Tail *tail,
+        const UserDataList *userDataList,
+        const Needle *text,
+        const size_t length,
+        const SearchMode mode,
+        SearchHandler *handler,
+        void *context
+) {
+    if (mode & SEARCH_MODE_EXACT) {
+        automaton_search_exact(automaton, tail, userDataList, text, length, mode, handler, context);
+    } else if (mode & (SEARCH_MODE_LEFTMOST_LONGEST | SEARCH_MODE_LEFTMOST_FIRST)) {
+        automaton_search_leftmost(automaton, tail, userDataList, text, length, mode, handler, context);
+    } else {
+        const int kernel = AUTOMATON_SEARCH_KERNEL_INDEX(tail != NULL, (mode & SEARCH_MODE_FIRST) != 0, automaton->transitions != NULL);
+        automaton_searchKernels[kernel](automaton, tail, userDataList, text, length, mode, handler, context);
+    }
+}
+
+// occurrences are only counted, nothing is allocated
+size_t automaton_searchCount(
+        const Automaton *automaton,
+        const Tail *tail,
+        const UserDataList *userDataList,
+        const Needle *text,
+        const size_t length,
+        const SearchMode mode
+) {
+    size_t count = 0;
+    automaton_searchEach(automaton, tail, userDataList, text, length, mode | SEARCH_MODE_COUNT, occurrenceCount_increment, &count);
+
+    return count;
+}
+
+bool automaton_searchExists(
+        const Automaton *automaton,
+        const Tail *tail,
+        const UserDataList *userDataList,
+        const Needle *text,
+        const size_t length,
+        const SearchMode mode
+) {
+    return automaton_searchCount(automaton, tail, userDataList, text, length, mode | SEARCH_MODE_EXISTS) > 0;
 }
 
 Occurrence *automaton_search(
@@ -431,9 +1812,304 @@ Occurrence *automaton_search(
         const Needle *needle,
         const SearchMode mode
 ) {
-    return mode & SEARCH_MODE_EXACT
-        ? automaton_search_exact(automaton, tail, userDataList, needle, mode)
-        : automaton_search_ac(automaton, tail, userDataList, needle, mode);
+    return automaton_searchWithLength(automaton, tail, userDataList, needle, strlen(needle), mode);
+}
+
+Occurrence *automaton_searchWithLength(
+        const Automaton *automaton,
+        const Tail *tail,
+        const UserDataList *userDataList,
+        const Needle *text,
+        const size_t length,
+        const SearchMode mode
+) {
+    OccurrenceList list = {NULL, NULL};
+    automaton_searchEach(automaton, tail, userDataList, text, length, mode, occurrenceList_append, &list);
+
+    return list.first;
+}
+
+
+SearchContext *createSearchContext(const size_t blockSize) {
+    SearchContext *searchContext = safeAlloc(sizeof(SearchContext), "search context");
+    searchContext->arena = createArena(blockSize);
+    searchContext->automaton = NULL;
+    searchContext->tail = NULL;
+    searchContext->hasNeedle = false;
+    searchContext->occurrences = (OccurrenceList) {NULL, NULL};
+
+    return searchContext;
+}
+
+// occurrences of all searches since the last reset are released at once
+void searchContext_reset(SearchContext *searchContext) {
+    arena_reset(searchContext->arena);
+    searchContext->occurrences = (OccurrenceList) {NULL, NULL};
+}
+
+void searchContext_free(SearchContext *searchContext) {
+    arena_free(searchContext->arena);
+    safeFree(searchContext);
+    searchContext = NULL;
+}
+
+// returned occurrences and their needles are owned by the context, they are valid until it is reset
+Occurrence *automaton_searchInContext(
+        const Automaton *automaton,
+        const Tail *tail,
+        const UserDataList *userDataList,
+        const Needle *text,
+        const size_t length,
+        const SearchMode mode,
+        SearchContext *searchContext
+) {
+    const bool isReference = automaton_isNeedleReference(mode);
+    searchContext->automaton = automaton;
+    searchContext->tail = tail;
+    searchContext->hasNeedle = mode & SEARCH_MODE_NEEDLE && !isReference;
+    searchContext->occurrences = (OccurrenceList) {NULL, NULL};
+
+    const SearchMode searchMode = searchContext->hasNeedle ? mode & ~SEARCH_MODE_NEEDLE : mode;
+    automaton_searchEach(automaton, tail, userDataList, text, length, searchMode, searchContext_append, searchContext);
+
+    return searchContext->occurrences.first;
+}
+
+SearchState *createSearchState(
+        const Automaton *automaton,
+        const Tail *tail,
+        const UserDataList *userDataList,
+        const SearchMode mode
+) {
+    if (unlikely(mode & SEARCH_MODE_EXACT)) {
+        error("exact search can not be streamed");
+    }
+    if (unlikely(mode & (SEARCH_MODE_LEFTMOST_LONGEST | SEARCH_MODE_LEFTMOST_FIRST))) {
+        error("leftmost search can not be streamed");
+    }
+    if (unlikely(mode & SEARCH_MODE_WHOLE_WORD)) {
+        error("whole word search can not be streamed");
+    }
+
+    SearchState *searchState = safeAlloc(sizeof(SearchState), "search state");
+    searchState->automaton = automaton;
+    searchState->tail = tail;
+    searchState->userDataList = userDataList;
+    searchState->mode = mode;
+    searchState->pendingTails = NULL;
+    searchState->pendingSize = 0;
+
+    searchState_reset(searchState);
+
+    return searchState;
+}
+
+void searchState_free(SearchState *searchState) {
+    safeFree(searchState->pendingTails);
+    safeFree(searchState);
+    searchState = NULL;
+}
+
+static void searchState_reset(SearchState *searchState) {
+    searchState->state = TRIE_POOL_START;
+    searchState->index = 0;
+    searchState->characterIndex = 0;
+    searchState->partialLength = 0;
+    searchState->partialExpected = 0;
+    searchState->pendingCount = 0;
+    searchState->isStopped = false;
+}
+
+static bool searchState_report(
+        SearchState *searchState,
+        const AutomatonIndex state,
+        const size_t index,
+        const size_t characterIndex,
+        SearchHandler *handler,
+        void *context
+) {
+    Occurrence occurrence;
+    automaton_fillOccurrence(
+        &occurrence,
+        searchState->automaton,
+        searchState->tail,
+        searchState->userDataList,
+        state,
+        index,
+        characterIndex,
+        searchState->mode
+    );
+
+    if (!handler(&occurrence, context) || searchState->mode & SEARCH_MODE_FIRST) {
+        searchState->isStopped = true;
+    }
+
+    return !searchState->isStopped;
+}
+
+static void searchState_pushTail(SearchState *searchState, const AutomatonIndex state) {
+    if (unlikely(searchState->pendingCount == searchState->pendingSize)) {
+        const size_t newSize = calculateAllocation(searchState->pendingSize);
+        searchState->pendingTails = searchState->pendingTails == NULL
+            ? safeAlloc(newSize * sizeof(PendingTail), "search state tails")
+            : safeRealloc(searchState->pendingTails, searchState->pendingSize, newSize, sizeof(PendingTail), "search state tails");
+        searchState->pendingSize = newSize;
+    }
+
+    searchState->pendingTails[searchState->pendingCount++] = (PendingTail) {
+        state, 0, searchState->index, searchState->characterIndex
+    };
+}
+
+// tail characters are outside the automaton, so they are compared as the next characters of the stream arrive
+static bool searchState_advanceTails(SearchState *searchState, const Character character, SearchHandler *handler, void *context) {
+    size_t kept = 0;
+
+    for (size_t i = 0; i < searchState->pendingCount; i++) {
+        PendingTail pending = searchState->pendingTails[i];
+        const TailCell tailCell = tail_getCell(searchState->tail, -automaton_getBase(searchState->automaton, pending.state));
+
+        if (tailCell_readCharacter(tailCell, &pending.matched) != character) {
+            continue;
+        }
+
+        if (pending.matched == tailCell.length) {
+            if (!searchState_report(searchState, pending.state, pending.index, pending.characterIndex, handler, context)) {
+                return false;
+            }
+            continue;
+        }
+
+        searchState->pendingTails[kept++] = pending;
+    }
+
+    searchState->pendingCount = kept;
+
+    return true;
+}
+
+static bool searchState_character(
+        SearchState *searchState,
+        const TextCharacter character,
+        SearchHandler *handler,
+        void *context
+) {
+    const Automaton *automaton = searchState->automaton;
+
+    searchState->index += character.length;
+    searchState->characterIndex += character.characters;
+
+    if (searchState->pendingCount && !searchState_advanceTails(searchState, character.character, handler, context)) {
+        return false;
+    }
+
+    AutomatonIndex nextState = searchState->state = automaton_transition(automaton, searchState->state, character.character);
+
+    while (nextState) {
+        const AutomatonIndex base = automaton_getBase(automaton, nextState);
+        const AutomatonIndex endState = createState(END_OF_TEXT, base);
+
+        if (base > 0 && automaton_getCheck(automaton, endState) == nextState) {
+            if (!searchState_report(searchState, endState, searchState->index, searchState->characterIndex, handler, context)) {
+                return false;
+            }
+        } else if (base < 0) {
+            searchState_pushTail(searchState, nextState);
+        }
+
+        nextState = automaton_getOutput(automaton, nextState);
+    }
+
+    return true;
+}
+
+bool searchState_feed(
+        SearchState *searchState,
+        const Needle *chunk,
+        const size_t length,
+        SearchHandler *handler,
+        void *context
+) {
+    size_t index = 0;
+
+    if (unlikely(searchState->isStopped)) {
+        return false;
+    }
+
+    if (searchState->partialLength) {
+        while (searchState->partialLength < searchState->partialExpected && index < length) {
+            searchState->partial[searchState->partialLength++] = chunk[index++];
+        }
+
+        if (searchState->partialLength < searchState->partialExpected) {
+            return true;
+        }
+
+        const TextCharacter character = automaton_readCharacter(
+            searchState->automaton,
+            searchState->partial,
+            (size_t)searchState->partialLength,
+            0
+        );
+        searchState->partialLength = 0;
+
+        if (unlikely(!character.length)) {
+            searchState->isStopped = true;
+            return false;
+        }
+
+        if (!searchState_character(searchState, character, handler, context)) {
+            return false;
+        }
+    }
+
+    if (searchState->automaton->useByteAlphabet) {
+        while (index < length) {
+            const TextCharacter character = automaton_readCharacter(searchState->automaton, chunk, length, index++);
+            if (!searchState_character(searchState, character, handler, context)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Character characters[DECODE_BLOCK_SIZE];
+    while (index < length) {
+        const Utf8Decoded decoded = utf8Decode(chunk + index, length - index, characters, DECODE_BLOCK_SIZE);
+
+        for (size_t i = 0, position = index; i < decoded.characters; i++) {
+            const int characterLength = utf8Length((unsigned char)chunk[position]);
+            const TextCharacter character = {automaton_getSymbol(searchState->automaton, characters[i]), characterLength, 1};
+            position += characterLength;
+
+            if (!searchState_character(searchState, character, handler, context)) {
+                return false;
+            }
+        }
+
+        index += decoded.length;
+
+        if (unlikely(!decoded.isValid)) {
+            searchState->isStopped = true;
+            return false;
+        }
+
+        if (!decoded.characters) {
+            searchState->partialExpected = utf8Length((unsigned char)chunk[index]);
+            while (index < length) {
+                searchState->partial[searchState->partialLength++] = chunk[index++];
+            }
+        }
+    }
+
+    return true;
+}
+
+bool searchState_finish(SearchState *searchState) {
+    const bool isComplete = searchState->partialLength == 0;
+    searchState_reset(searchState);
+
+    return isComplete;
 }
 
 size_t automaton_getSize(const Automaton *automaton) {
@@ -2,18 +2,51 @@
 #define AC_H
 
 #include "../include/ac.h"
+#include "definitions.h"
+#include "prefilter.h"
+#include "alphabet.h"
+#include "needle.h"
+#include "needle_table.h"
+#include "tail.h"
 #include "user_data.h"
+#include "arena.h"
 
 
 typedef int32_t AutomatonTransition, AutomatonIndex;
 
+// split layout keeps only base and check (read by every transition) in cells, fail and output have own arrays
+#ifdef AUTOMATON_SPLIT_CELLS
+typedef struct {
+    AutomatonIndex base, check;
+} AutomatonCell;
+#else
 typedef struct {
     AutomatonIndex base, check, fail, output;
 } AutomatonCell;
+#endif
+
+#define TRANSITION_TABLE_ALPHABET 256
+#define DECODE_BLOCK_SIZE 256
+#define SEARCH_BATCH_LANES 8
+#define SEARCH_PARALLEL_MIN_CHUNK 65536
 
 typedef struct automaton {
     AutomatonIndex size;
     AutomatonCell *cells;
+#ifdef AUTOMATON_SPLIT_CELLS
+    AutomatonIndex *fails, *outputs;
+#endif
+    AutomatonIndex *depths, *byteDepths, *characterDepths; // transitions, bytes and characters from the root
+    NeedleId *needleIds;
+    size_t maxNeedleLength;
+    AutomatonIndex unfoldedStart; // first state of unfolded tail, size of the automaton without it
+    bool useByteAlphabet, useCaseFolding;
+    Alphabet *alphabet;
+    NeedleTable *needleTable;
+    AutomatonIndex *transitions;
+    unsigned char transitionClasses[TRANSITION_TABLE_ALPHABET];
+    int transitionClassCount;
+    Prefilter prefilter;
 } Automaton;
 
 typedef struct {
@@ -21,13 +54,102 @@ typedef struct {
     int length;
 } FoundNeedle;
 
+typedef struct {
+    size_t start, end;
+} FoundOffset;
+
+typedef struct {
+    size_t length, characters;
+} NeedleSize;
+
+typedef struct {
+    Character character;
+    int length, characters;
+} TextCharacter;
+
 typedef struct occurrence {
     struct occurrence *next;
+    AutomatonIndex state;
+    NeedleId needleId;
     FoundNeedle needle;
+    FoundOffset offset, characterOffset;
     UserData userData;
 } Occurrence;
+typedef struct {
+    Occurrence *first, *last;
+} OccurrenceList;
+
 typedef enum searchMode SearchMode;
 
+typedef void (SearchKernel)(
+    const Automaton *automaton,
+    const Tail *tail,
+    const UserDataList *userDataList,
+    const Needle *text,
+    size_t length,
+    SearchMode mode,
+    SearchHandler *handler,
+    void *context
+);
+
+typedef struct {
+    const Needle *text;
+    size_t length, index, characterIndex;
+    AutomatonIndex state;
+    TextCharacter next; // read ahead at nextIndex to prefetch its transition, length 0 if none
+    size_t nextIndex;
+    void *context;
+} SearchLane;
+
+// part of the text searched by one worker, matches starting in [start, end) are kept,
+// the search continues up to searchEnd to find those crossing the end
+typedef struct {
+    const Automaton *automaton;
+    const Tail *tail;
+    const UserDataList *userDataList;
+    const Needle *text;
+    size_t length, start, end, searchEnd, characters;
+    SearchMode mode;
+    OccurrenceList occurrences;
+} SearchChunk;
+
+typedef struct {
+    AutomatonIndex state;
+    TailCharIndex matched;
+    size_t index, characterIndex;
+} PendingTail;
+
+typedef struct {
+    AutomatonIndex state;
+    size_t index, characterIndex, start, end;
+    NeedleId needleId;
+} LeftmostMatch;
+
+typedef struct searchContext {
+    Arena *arena;
+    const Automaton *automaton;
+    const Tail *tail;
+    bool hasNeedle;
+    OccurrenceList occurrences;
+} SearchContext;
+
+typedef struct searchState {
+    const Automaton *automaton;
+    const Tail *tail;
+    const UserDataList *userDataList;
+    SearchMode mode;
+    AutomatonIndex state;
+    size_t index, characterIndex;
+    char partial[4];
+    int partialLength, partialExpected;
+    PendingTail *pendingTails;
+    size_t pendingSize, pendingCount;
+    bool isStopped;
+} SearchState;
+
 Automaton *createAutomaton(AutomatonIndex initialSize);
+AutomatonIndex *createTransitionTable(AutomatonIndex size, int classCount);
+void automaton_buildDepths(Automaton *automaton);
+void automaton_buildMaxNeedleLength(Automaton *automaton, const Tail *tail);
 
 #endif
@@ -0,0 +1,88 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "alphabet.h"
+#include "memory.h"
+
+
+static void alphabet_reallocate(Alphabet *alphabet, Character newSize);
+
+
+Alphabet *createAlphabet(const Character initialSize) {
+    Alphabet *alphabet = safeAlloc(sizeof(Alphabet), "Alphabet");
+
+    const size_t pagesSize = ALPHABET_PAGE_COUNT * sizeof(Character*);
+    alphabet->pages = safeAlloc(pagesSize, "Alphabet pages");
+    resetMemory(alphabet->pages, pagesSize);
+
+    alphabet->size = initialSize;
+    alphabet->count = 0;
+    alphabet->characters = safeAlloc(initialSize * sizeof(Character), "Alphabet characters");
+
+    return alphabet;
+}
+
+Alphabet *alphabet_clone(const Alphabet *alphabet) {
+    Alphabet *clone = createAlphabet(alphabet->count ?: 1);
+
+    for (Character i = 0; i < alphabet->count; i++) {
+        alphabet_addCharacter(clone, alphabet->characters[i]);
+    }
+
+    return clone;
+}
+
+static void alphabet_reallocate(Alphabet *alphabet, const Character newSize) {
+    alphabet->characters = safeRealloc(alphabet->characters, alphabet->size, newSize, sizeof(Character), "Alphabet characters");
+    alphabet->size = newSize;
+}
+
+Character alphabet_addCharacter(Alphabet *alphabet, const Character character) {
+    if (unlikely((u_int32_t)character > ALPHABET_MAX_CHARACTER)) {
+        error("character out of Unicode range");
+    }
+
+    Character *page = alphabet->pages[character >> ALPHABET_PAGE_BITS];
+    if (page == NULL) {
+        page = safeAlloc(ALPHABET_PAGE_SIZE * sizeof(Character), "Alphabet page");
+        resetMemory(page, ALPHABET_PAGE_SIZE * sizeof(Character));
+        alphabet->pages[character >> ALPHABET_PAGE_BITS] = page;
+    }
+
+    Character *symbol = &page[character & (ALPHABET_PAGE_SIZE - 1)];
+    if (*symbol == ALPHABET_UNKNOWN_SYMBOL) {
+        if (alphabet->count == alphabet->size) {
+            alphabet_reallocate(alphabet, (Character)calculateAllocation((size_t)alphabet->size));
+        }
+
+        alphabet->characters[alphabet->count] = character;
+        *symbol = ALPHABET_FIRST_SYMBOL + alphabet->count++;
+    }
+
+    return *symbol;
+}
+
+Character alphabet_getCharacter(const Alphabet *alphabet, const Character symbol) {
+    return alphabet->characters[symbol - ALPHABET_FIRST_SYMBOL];
+}
+
+TrieNeedle *alphabet_mapNeedle(Alphabet *alphabet, const TrieNeedle *needle) {
+    TrieNeedle *symbolNeedle = safeAlloc(sizeof(TrieNeedle), "symbol needle");
+    symbolNeedle->length = needle->length;
+    symbolNeedle->characters = safeAlloc(needle->length * sizeof(Character), "symbol needle characters");
+
+    for (TrieNeedleIndex i = 0; i < needle->length; i++) {
+        symbolNeedle->characters[i] = alphabet_addCharacter(alphabet, needle->characters[i]);
+    }
+
+    return symbolNeedle;
+}
+
+void alphabet_free(Alphabet *alphabet) {
+    for (size_t i = 0; i < ALPHABET_PAGE_COUNT; i++) {
+        safeFree(alphabet->pages[i]);
+    }
+    safeFree(alphabet->pages);
+    safeFree(alphabet->characters);
+    safeFree(alphabet);
+    alphabet = NULL;
+}
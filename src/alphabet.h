@@ -0,0 +1,39 @@
+#ifndef ALPHABET_H
+#define ALPHABET_H
+
+#include "definitions.h"
+#include "needle.h"
+
+
+#define ALPHABET_MAX_CHARACTER 0x10FFFF
+#define ALPHABET_PAGE_BITS 8
+#define ALPHABET_PAGE_SIZE (1 << ALPHABET_PAGE_BITS)
+#define ALPHABET_PAGE_COUNT ((ALPHABET_MAX_CHARACTER >> ALPHABET_PAGE_BITS) + 1)
+#define ALPHABET_UNKNOWN_SYMBOL 0
+#define ALPHABET_FIRST_SYMBOL (END_OF_TEXT + 1)
+
+// maps characters to dense symbols (in order of insertion) and back, page of the map is allocated with its first character
+typedef struct alphabet {
+    Character **pages;
+    Character *characters;
+    Character size, count;
+} Alphabet;
+
+
+Alphabet *createAlphabet(Character initialSize);
+Alphabet *alphabet_clone(const Alphabet *alphabet);
+Character alphabet_addCharacter(Alphabet *alphabet, Character character);
+Character alphabet_getCharacter(const Alphabet *alphabet, Character symbol);
+TrieNeedle *alphabet_mapNeedle(Alphabet *alphabet, const TrieNeedle *needle);
+void alphabet_free(Alphabet *alphabet);
+
+static inline Character alphabet_getSymbol(const Alphabet *alphabet, const Character character) {
+    if (unlikely((u_int32_t)character > ALPHABET_MAX_CHARACTER)) {
+        return ALPHABET_UNKNOWN_SYMBOL;
+    }
+
+    const Character *page = alphabet->pages[character >> ALPHABET_PAGE_BITS];
+    return page == NULL ? ALPHABET_UNKNOWN_SYMBOL : page[character & (ALPHABET_PAGE_SIZE - 1)];
+}
+
+#endif
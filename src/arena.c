@@ -0,0 +1,61 @@
+#include <stdlib.h>
+#include "arena.h"
+#include "memory.h"
+
+
+static ArenaBlock *createArenaBlock(size_t size, ArenaBlock *next);
+
+
+static ArenaBlock *createArenaBlock(const size_t size, ArenaBlock *next) {
+    ArenaBlock *block = safeAlloc(sizeof(ArenaBlock) + size, "Arena block");
+    block->next = next;
+    block->size = size;
+
+    return block;
+}
+
+Arena *createArena(const size_t blockSize) {
+    Arena *arena = safeAlloc(sizeof(Arena), "Arena");
+    arena->blockSize = blockSize ?: ARENA_BLOCK_SIZE;
+    arena->first = arena->current = createArenaBlock(arena->blockSize, NULL);
+    arena->used = 0;
+
+    return arena;
+}
+
+// blocks kept from before the reset are used first, larger allocation gets own block
+void *arena_alloc(Arena *arena, const size_t size) {
+    size_t start = (arena->used + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+    if (unlikely(start + size > arena->current->size)) {
+        ArenaBlock *next = arena->current->next;
+        if (next == NULL || next->size < size) {
+            next = createArenaBlock(size > arena->blockSize ? size : arena->blockSize, next);
+            arena->current->next = next;
+        }
+
+        arena->current = next;
+        start = 0;
+    }
+
+    arena->used = start + size;
+
+    return arena->current->data + start;
+}
+
+void arena_reset(Arena *arena) {
+    arena->current = arena->first;
+    arena->used = 0;
+}
+
+void arena_free(Arena *arena) {
+    ArenaBlock *block = arena->first;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        safeFree(block);
+        block = next;
+    }
+
+    safeFree(arena);
+    arena = NULL;
+}
@@ -0,0 +1,28 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "definitions.h"
+
+
+#define ARENA_BLOCK_SIZE 65536
+#define ARENA_ALIGNMENT 16
+
+typedef struct arenaBlock {
+    struct arenaBlock *next;
+    size_t size;
+    char data[];
+} ArenaBlock;
+
+// bump allocator, reset keeps its blocks for next allocations
+typedef struct arena {
+    ArenaBlock *first, *current;
+    size_t used, blockSize;
+} Arena;
+
+
+Arena *createArena(size_t blockSize);
+void *arena_alloc(Arena *arena, size_t size);
+void arena_reset(Arena *arena);
+void arena_free(Arena *arena);
+
+#endif
@@ -20,18 +20,33 @@ static void trie_poolCheckCapacity(Trie *trie, TrieIndex index);
 static void trie_allocateCell(Trie *trie, TrieIndex cell);
 static void trie_freeCell(Trie *trie, TrieIndex cell);
 static void trie_insertNode(Trie *trie, TrieIndex state, TrieBase base, TrieIndex check);
-static void trie_insertEndOfText(Trie *trie, TrieIndex check, UserData userData);
-static void trie_insertBranch(Trie *trie, TrieIndex state, TrieIndex check, const TrieNeedle *needle, TrieNeedleIndex needleIndex, UserData userData);
-static void trie_collisionInTail(Trie *trie, TrieIndex state, const TrieNeedle *needle, TrieNeedleIndex needleIndex, UserData userData);
-static inline TrieIndex trie_collisionInTail_needle(Trie *trie, TrieIndex state, const TrieNeedle *needle, TrieNeedleIndex needleIndex, UserData userData);
-static inline TrieIndex trie_collisionInTail_tail(Trie *trie, TrieIndex state, TrieIndex tailIndex, TailCharIndex tailIterator, UserData userData);
+static NeedleId trie_setNeedle(Trie *trie, TrieIndex state, UserData userData, NeedleId needleId);
+static NeedleId trie_insertEndOfText(Trie *trie, TrieIndex check, UserData userData, NeedleId needleId);
+static void trie_insertBranch(Trie *trie, TrieIndex state, TrieIndex check, const TrieNeedle *needle, TrieNeedleIndex needleIndex, UserData userData, NeedleId needleId);
+static NeedleId trie_collisionInTail(Trie *trie, TrieIndex state, const TrieNeedle *needle, TrieNeedleIndex needleIndex, UserData userData, NeedleId needleId);
+static inline TrieIndex trie_collisionInTail_needle(Trie *trie, TrieIndex state, const TrieNeedle *needle, TrieNeedleIndex needleIndex, UserData userData, NeedleId needleId);
+static inline TrieIndex trie_collisionInTail_tail(Trie *trie, TrieIndex state, TrieIndex tailIndex, TailCharIndex tailIterator, UserData userData, NeedleId needleId);
 static inline TrieIndex trie_collisionInTail_common(Trie *trie, TrieIndex state, TailCharIndex commonTail, TailBuilderCell tailBuilderCell);
 static TrieIndex trie_collisionInArray(Trie *trie, TrieIndex state, TrieBase base, TrieIndex check, Character character);
 static TrieIndex trie_moveBase(Trie *trie, TrieBase oldBase, TrieBase freeBase, TrieIndex check, TrieIndex state);
 static TrieIndex trie_findEmptyCell(const Trie *trie, TrieIndex node);
 static TrieIndex trie_findFreeBase(const Trie *trie, TrieIndex node);
 static TrieIndex trie_storeCharacter(Trie *trie, TrieIndex lastState, TrieBase newNodeBase, Character character);
-static TrieIndex trie_storeNeedle(Trie *trie, TrieIndex lastState, const TrieNeedle *needle, TrieNeedleIndex needleIndex, UserData userData);
+static TrieIndex trie_storeNeedle(Trie *trie, TrieIndex lastState, const TrieNeedle *needle, TrieNeedleIndex needleIndex, UserData userData, NeedleId needleId, NeedleId *storedId);
+static NeedleId trie_insertNeedle(Trie *trie, const TrieNeedle *needle, UserData userData, NeedleId needleId);
+static TrieKey trie_createKey(Trie *trie, const TrieNeedle *needle);
+static void trieKey_free(TrieKey key);
+static int trieSortedKey_compareSymbols(const TrieSortedKey *first, const TrieSortedKey *second);
+static int trieSortedKey_compare(const void *a, const void *b);
+
+static void trieBuilder_enqueue(TrieBuilder *builder, TrieBuilderNode node);
+static void trieBuilder_reserveLabels(TrieBuilder *builder, size_t size);
+static void trieBuilder_reserveTrials(TrieBuilder *builder);
+static bool trieBuilder_isFreeBase(const TrieBuilder *builder, TrieBase base, size_t labelCount);
+static TrieBase trieBuilder_findBase(TrieBuilder *builder, size_t labelCount);
+static void trieBuilder_moveScanStart(TrieBuilder *builder);
+static void trieBuilder_insertChild(TrieBuilder *builder, TrieIndex state, TrieBase base, Character label, size_t from, size_t to, TrieNeedleIndex depth);
+static void trieBuilder_placeChildren(TrieBuilder *builder, TrieBuilderNode node);
 
 
 const UserData emptyUserData = {0};
@@ -51,13 +66,33 @@ TrieOptions *createTrieOptions(const bool useTail, const bool useUserData, const
 
     options->useTail = useTail;
     options->useUserData = useUserData;
+    options->useByteAlphabet = false;
+    options->useDenseAlphabet = false;
+    options->useCaseFolding = false;
+    options->useTailDeduplication = false;
     options->childListInitSize = childListInitSize;
 
     return options;
 }
 
+void trieOptions_setByteAlphabet(TrieOptions *options, const bool useByteAlphabet) {
+    options->useByteAlphabet = useByteAlphabet;
+}
+
+void trieOptions_setDenseAlphabet(TrieOptions *options, const bool useDenseAlphabet) {
+    options->useDenseAlphabet = useDenseAlphabet;
+}
+
+void trieOptions_setCaseFolding(TrieOptions *options, const bool useCaseFolding) {
+    options->useCaseFolding = useCaseFolding;
+}
+
+void trieOptions_setTailDeduplication(TrieOptions *options, const bool useTailDeduplication) {
+    options->useTailDeduplication = useTailDeduplication;
+}
+
 void trieOptions_free(TrieOptions *options) {
-    free(options);
+    safeFree(options);
     options = NULL;
 }
 
@@ -72,11 +107,20 @@ Trie *createTrie(TrieOptions *options, TailBuilder *tailBuilder, UserDataList *u
     trie->options = options;
     trie->tailBuilder = tailBuilder;
     trie->userDataList = userDataList;
+    if (options->useTail && options->useTailDeduplication) {
+        tailBuilder_useDeduplication(tailBuilder);
+    }
+    trie->alphabet = options->useDenseAlphabet ? createAlphabet(TRIE_ALPHABET_INIT_SIZE) : NULL;
+    trie->needleTable = options->useCaseFolding ? createNeedleTable(NEEDLE_TABLE_INIT_SIZE, NEEDLE_TABLE_INIT_SIZE) : NULL;
     trie->size = (TrieIndex)initialSize;
     trie->cells = safeAlloc(trie->size * sizeof(TrieCell), "Trie cells");
+    trie->needleIds = safeAlloc(trie->size * sizeof(NeedleId), "Trie needle IDs");
+    trie->needleCount = 0;
+    trie->maxNeedleLength = 0;
     trie->cells[0] = (TrieCell) {-(trie->size - 1), -2, NULL}; // TRIE_POOL_INFO
     trie->cells[1] = (TrieCell) {1, 0, createList(options->childListInitSize)}; // TRIE_POOL_START
     trie->cells[2] = (TrieCell) {0, -3, NULL};
+    trie->needleIds[0] = trie->needleIds[1] = trie->needleIds[2] = NEEDLE_ID_NONE;
 
     trie_poolInit(trie, 3, trie->size);
 
@@ -96,8 +140,15 @@ void trie_free(Trie *trie) {
             list_free(children);
         }
     }
-    free(trie->cells);
-    free(trie);
+    if (trie->alphabet != NULL) {
+        alphabet_free(trie->alphabet);
+    }
+    if (trie->needleTable != NULL) {
+        needleTable_free(trie->needleTable);
+    }
+    safeFree(trie->cells);
+    safeFree(trie->needleIds);
+    safeFree(trie);
     trie = NULL;
 }
 
@@ -130,11 +181,13 @@ static void trie_setChildren(Trie *trie, const TrieIndex index, List *children)
 static void trie_poolInit(Trie *trie, const TrieIndex fromIndex, const TrieIndex toIndex) {
     for (TrieIndex i = fromIndex; i < toIndex; i++) {
         trie->cells[i] = (TrieCell) {-(i - 1), -(i + 1), NULL};
+        trie->needleIds[i] = NEEDLE_ID_NONE;
     }
 }
 
 static void trie_poolReallocate(Trie *trie, const TrieIndex newSize) {
     trie->cells = safeRealloc(trie->cells, trie->size, newSize, sizeof(TrieCell), "Trie");
+    trie->needleIds = safeRealloc(trie->needleIds, trie->size, newSize, sizeof(NeedleId), "Trie needle IDs");
 
     trie_poolInit(trie, trie->size, newSize);
 
@@ -254,6 +307,7 @@ static TrieIndex trie_moveBase(
     const List *checkChildren = trie_getChildren(trie, check);
 
     UserData charUserData;
+    NeedleId charNeedleId;
     ListIndex checkListIndex = list_iterate(checkChildren, 0);
     while (likely(checkListIndex > 0)) {
         const Character character = list_getValue(checkChildren, checkListIndex);
@@ -264,6 +318,7 @@ static TrieIndex trie_moveBase(
         if (trie->options->useUserData) {
             charUserData = userDataList_get(trie->userDataList, charIndex);
         }
+        charNeedleId = trie->needleIds[charIndex];
 
         if (charIndex == nextState) {
             nextState = newCharIndex;
@@ -290,6 +345,8 @@ static TrieIndex trie_moveBase(
             userDataList_set(trie->userDataList, charIndex, (UserData){NULL, 0});
             userDataList_set(trie->userDataList, newCharIndex, charUserData);
         }
+        trie->needleIds[charIndex] = NEEDLE_ID_NONE;
+        trie->needleIds[newCharIndex] = charNeedleId;
 
         checkListIndex = list_iterate(checkChildren, checkListIndex);
     }
@@ -366,7 +423,9 @@ static TrieIndex trie_storeNeedle(
         const TrieIndex lastState,
         const TrieNeedle *needle,
         const TrieNeedleIndex needleIndex,
-        const UserData userData
+        const UserData userData,
+        const NeedleId needleId,
+        NeedleId *storedId
 ) {
     const TrieBase lastBase = trie_getBase(trie, lastState);
     const Character character = needle->characters[needleIndex];
@@ -377,7 +436,8 @@ static TrieIndex trie_storeNeedle(
 
     if (check <= 0) {
         if (trie->options->useTail) {
-            trie_insertBranch(trie, newState, lastState, needle, needleIndex, userData);
+            trie_insertBranch(trie, newState, lastState, needle, needleIndex, userData, needleId);
+            *storedId = needleId;
             return 0;
         } else {
             trie_insertNode(trie, newState, 1, lastState);
@@ -386,18 +446,28 @@ static TrieIndex trie_storeNeedle(
     } else if (check != lastState) {
         return trie_collisionInArray(trie, newState, 1, lastState, character);
     } else if (base < 0 && trie->options->useTail) {
-        trie_collisionInTail(trie, newState, needle, needleIndex, userData);
+        *storedId = trie_collisionInTail(trie, newState, needle, needleIndex, userData, needleId);
         return 0;
     } else {
         return newState;
     }
 }
 
-static void trie_insertEndOfText(Trie *trie, const TrieIndex check, const UserData userData) {
-    TrieIndex state = trie_storeCharacter(trie, check, trie_getBase(trie, check), END_OF_TEXT);
+// the needle ID of a duplicate needle stays the one of its first insertion
+static NeedleId trie_setNeedle(Trie *trie, const TrieIndex state, const UserData userData, const NeedleId needleId) {
     if (trie->options->useUserData) {
         userDataList_set(trie->userDataList, state, userData);
     }
+    if (trie->needleIds[state] == NEEDLE_ID_NONE) {
+        trie->needleIds[state] = needleId;
+    }
+
+    return trie->needleIds[state];
+}
+
+static NeedleId trie_insertEndOfText(Trie *trie, const TrieIndex check, const UserData userData, const NeedleId needleId) {
+    TrieIndex state = trie_storeCharacter(trie, check, trie_getBase(trie, check), END_OF_TEXT);
+    return trie_setNeedle(trie, state, userData, needleId);
 }
 
 static void trie_insertBranch(
@@ -406,7 +476,8 @@ static void trie_insertBranch(
         const TrieIndex check,
         const TrieNeedle *needle,
         const TrieNeedleIndex needleIndex,
-        const UserData userData
+        const UserData userData,
+        const NeedleId needleId
 ) {
     TrieBase newNodeBase = 1;
     const TailCharIndex tailCharsLength = needle->length - needleIndex - 1;
@@ -424,9 +495,9 @@ static void trie_insertBranch(
     }
 
     trie_insertNode(trie, state, newNodeBase, check);
-    userDataList_set(trie->userDataList, state, userData);
+    trie_setNeedle(trie, state, userData, needleId);
     if (likely(newNodeBase > 0)) {
-        trie_insertEndOfText(trie, state, userData);
+        trie_insertEndOfText(trie, state, userData, needleId);
     }
 }
 
@@ -451,7 +522,8 @@ static inline TrieIndex trie_collisionInTail_needle(
         const TrieIndex state,
         const TrieNeedle *needle,
         const TrieNeedleIndex needleIndex,
-        const UserData userData
+        const UserData userData,
+        const NeedleId needleId
 ) {
     const TrieNeedleIndex leftCharacters = needle->length - needleIndex;
     TrieIndex endState = state, newState = state;
@@ -472,11 +544,11 @@ static inline TrieIndex trie_collisionInTail_needle(
     if (1 <= leftCharacters) {
         endState = trie_storeCharacter(trie, state, newBase,needle->characters[needleIndex]);
         newState = trie_getCheck(trie, endState);
-        userDataList_set(trie->userDataList, endState, userData);
+        trie_setNeedle(trie, endState, userData, needleId);
     }
 
     if (1 >= leftCharacters) {
-        trie_insertEndOfText(trie, endState, userData);
+        trie_insertEndOfText(trie, endState, userData, needleId);
     }
 
     return newState;
@@ -487,7 +559,8 @@ static inline TrieIndex trie_collisionInTail_tail(
         const TrieIndex state,
         const TrieIndex tailIndex,
         const TailCharIndex tailIterator,
-        const UserData userData
+        const UserData userData,
+        const NeedleId needleId
 ) {
     const TailBuilderCell tailBuilderCell = trie->tailBuilder->cells[tailIndex];
     const TrieNeedleIndex leftCharacters = tailBuilderCell.length - tailIterator;
@@ -509,27 +582,29 @@ static inline TrieIndex trie_collisionInTail_tail(
     if (1 <= leftCharacters) {
         endState = trie_storeCharacter(trie, state, newBase, tailBuilderCell.chars[tailIterator]);
         newState = trie_getCheck(trie, endState);
-        userDataList_set(trie->userDataList, endState, userData);
+        trie_setNeedle(trie, endState, userData, needleId);
     }
 
     if (1 >= leftCharacters) {
-        trie_insertEndOfText(trie, endState, userData);
+        trie_insertEndOfText(trie, endState, userData, needleId);
     }
 
     return newState;
 }
 
-static void trie_collisionInTail(
+static NeedleId trie_collisionInTail(
         Trie *trie,
         const TrieIndex state,
         const TrieNeedle *needle,
         const TrieNeedleIndex needleIndex,
-        const UserData userData
+        const UserData userData,
+        const NeedleId needleId
 ) {
     UserData stateUserData;
     if (trie->options->useUserData) {
         stateUserData = userDataList_get(trie->userDataList, state);
     }
+    const NeedleId stateNeedleId = trie->needleIds[state];
     const TrieIndex tailIndex = -trie_getBase(trie, state);
     const TailBuilderCell tailBuilderCell = trie->tailBuilder->cells[tailIndex];
 
@@ -544,42 +619,369 @@ static void trie_collisionInTail(
     }
 
     if (tailIterator == tailBuilderCell.length && needleIterator == needle->length) {
-        return;
+        return stateNeedleId;
     }
 
 
     trie_setBase(trie, state, 1);
     TrieIndex nextState = trie_collisionInTail_common(trie, state, tailIterator, tailBuilderCell);
-    nextState = trie_collisionInTail_needle(trie, nextState, needle, needleIterator, userData);
-    trie_collisionInTail_tail(trie, nextState, tailIndex, tailIterator, stateUserData);
+    nextState = trie_collisionInTail_needle(trie, nextState, needle, needleIterator, userData, needleId);
+    trie_collisionInTail_tail(trie, nextState, tailIndex, tailIterator, stateUserData, stateNeedleId);
 
 
     tailBuilder_freeCell(trie->tailBuilder, tailIndex);
+
+    return needleId;
 }
 
 
-void trie_addNeedle(Trie *trie, const TrieNeedle *needle) {
+// returns ID of the stored needle, which is the ID of the first insertion for a duplicate
+static NeedleId trie_insertNeedle(Trie *trie, const TrieNeedle *needle, const UserData userData, const NeedleId needleId) {
     TrieIndex lastState = TRIE_POOL_START;
+    NeedleId storedId = needleId;
 
     for (TrieNeedleIndex i = 0; i < needle->length; i++) {
-        lastState = trie_storeNeedle(trie, lastState, needle, i, emptyUserData);
+        lastState = trie_storeNeedle(trie, lastState, needle, i, userData, needleId, &storedId);
         if (0 == lastState) {
-            return;
+            return storedId;
         }
     }
 
-    trie_insertEndOfText(trie, lastState, emptyUserData);
+    return trie_insertEndOfText(trie, lastState, userData, needleId);
 }
 
-void trie_addNeedleWithData(Trie *trie, const TrieNeedle *needle, UserData data) {
-    TrieIndex lastState = TRIE_POOL_START;
+NeedleId trie_addNeedle(Trie *trie, const TrieNeedle *needle) {
+    return trie_addNeedleWithData(trie, needle, emptyUserData);
+}
 
-    for (TrieNeedleIndex i = 0; i < needle->length; i++) {
-        lastState = trie_storeNeedle(trie, lastState, needle, i, data);
-        if (0 == lastState) {
-            return;
+// folded needle is inserted, its dictionary form is kept in the needle table
+static TrieKey trie_createKey(Trie *trie, const TrieNeedle *needle) {
+    TrieKey key = {0};
+    key.folded = trie->options->useCaseFolding ? trieNeedle_fold(needle, trie->options->useByteAlphabet) : NULL;
+    const TrieNeedle *foldedNeedle = key.folded ? key.folded : needle;
+    key.bytes = trie->options->useByteAlphabet ? trieNeedle_toBytes(foldedNeedle) : NULL;
+    const TrieNeedle *characterNeedle = key.bytes ? key.bytes : foldedNeedle;
+    key.symbols = trie->alphabet ? alphabet_mapNeedle(trie->alphabet, characterNeedle) : NULL;
+    key.symbolNeedle = key.symbols ? key.symbols : characterNeedle;
+
+    // folding keeps UTF-8 length, so the key is as long as the matched text
+    const size_t needleLength = key.bytes ? key.bytes->length : trieNeedle_getUtf8Length(foldedNeedle);
+    if (needleLength > trie->maxNeedleLength) {
+        trie->maxNeedleLength = needleLength;
+    }
+
+    return key;
+}
+
+static void trieKey_free(const TrieKey key) {
+    if (key.symbols) {
+        trieNeedle_free(key.symbols);
+    }
+    if (key.bytes) {
+        trieNeedle_free(key.bytes);
+    }
+    if (key.folded) {
+        trieNeedle_free(key.folded);
+    }
+}
+
+// needle IDs are dense in order of insertion, duplicates get the ID of the first insertion
+NeedleId trie_addNeedleWithData(Trie *trie, const TrieNeedle *needle, UserData data) {
+    const TrieKey key = trie_createKey(trie, needle);
+
+    const NeedleId needleId = trie_insertNeedle(trie, key.symbolNeedle, data, trie->needleCount);
+    const bool isNew = needleId == trie->needleCount;
+    if (isNew) {
+        trie->needleCount++;
+    }
+
+    trieKey_free(key);
+    if (trie->needleTable && isNew) {
+        needleTable_add(trie->needleTable, needle);
+    }
+
+    return needleId;
+}
+
+
+static int trieSortedKey_compareSymbols(const TrieSortedKey *first, const TrieSortedKey *second) {
+    const TrieNeedleIndex length = first->length < second->length ? first->length : second->length;
+
+    for (TrieNeedleIndex i = 0; i < length; i++) {
+        if (first->characters[i] != second->characters[i]) {
+            return first->characters[i] < second->characters[i] ? -1 : 1;
         }
     }
+    if (first->length != second->length) {
+        return first->length < second->length ? -1 : 1;
+    }
+
+    return 0;
+}
+
+// duplicates stay in order of the input
+static int trieSortedKey_compare(const void *a, const void *b) {
+    const TrieSortedKey *first = (const TrieSortedKey *)a;
+    const TrieSortedKey *second = (const TrieSortedKey *)b;
+
+    return trieSortedKey_compareSymbols(first, second)
+        ?: (first->index > second->index) - (first->index < second->index);
+}
+
+static void trieBuilder_enqueue(TrieBuilder *builder, const TrieBuilderNode node) {
+    if (unlikely(builder->queueRear == builder->queueSize)) {
+        if (builder->queueFront > builder->queueSize / 2) {
+            memmove(builder->queue, builder->queue + builder->queueFront, (builder->queueRear - builder->queueFront) * sizeof(TrieBuilderNode));
+            builder->queueRear -= builder->queueFront;
+            builder->queueFront = 0;
+        } else {
+            const size_t newSize = calculateAllocation(builder->queueSize);
+            builder->queue = safeRealloc(builder->queue, builder->queueSize, newSize, sizeof(TrieBuilderNode), "Trie builder queue");
+            builder->queueSize = newSize;
+        }
+    }
+
+    builder->queue[builder->queueRear++] = node;
+}
+
+static void trieBuilder_reserveLabels(TrieBuilder *builder, const size_t size) {
+    if (builder->labelsSize < size) {
+        builder->labels = safeRealloc(builder->labels, builder->labelsSize, size, sizeof(Character), "Trie builder labels");
+        builder->labelEnds = safeRealloc(builder->labelEnds, builder->labelsSize, size, sizeof(size_t), "Trie builder label ends");
+        builder->labelsSize = size;
+    }
+}
+
+static void trieBuilder_reserveTrials(TrieBuilder *builder) {
+    const TrieIndex size = builder->trie->size;
+
+    if (builder->trialsSize < size) {
+        builder->trials = safeRealloc(builder->trials, builder->trialsSize, size, sizeof(unsigned char), "Trie builder trials");
+        resetMemory(builder->trials + builder->trialsSize, size - builder->trialsSize);
+        builder->trialsSize = size;
+    }
+}
+
+// cells behind the end of the pool are free, it grows when they are inserted
+static bool trieBuilder_isFreeBase(const TrieBuilder *builder, const TrieBase base, const size_t labelCount) {
+    for (size_t i = 0; i < labelCount; i++) {
+        const TrieIndex state = createState(builder->labels[i], base);
+        if (unlikely(state <= TRIE_POOL_START) || trie_getCheck(builder->trie, state) > 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
 
-    trie_insertEndOfText(trie, lastState, data);
+// first fit from the scan start, the free cells are walked in order of their indices
+static TrieBase trieBuilder_findBase(TrieBuilder *builder, const size_t labelCount) {
+    const Trie *trie = builder->trie;
+    Character minLabel = builder->labels[0];
+    for (size_t i = 1; i < labelCount; i++) {
+        if (builder->labels[i] < minLabel) {
+            minLabel = builder->labels[i];
+        }
+    }
+
+    trieBuilder_reserveTrials(builder);
+
+    TrieIndex cell = builder->scanStart > minLabel ? builder->scanStart : createState(minLabel, 1);
+    while (cell < trie->size && trie_getCheck(trie, cell) > 0) {
+        cell++;
+    }
+    if (cell >= trie->size) {
+        cell = 0;
+    }
+
+    while (cell != 0) {
+        const TrieBase base = cell - minLabel;
+        if (trieBuilder_isFreeBase(builder, base, labelCount)) {
+            return base;
+        }
+        if (builder->trials[cell] < TRIE_BUILDER_MAX_TRIALS) {
+            builder->trials[cell]++;
+        }
+        cell = -trie_getCheck(trie, cell);
+    }
+
+    return trie->size > minLabel + 1 ? trie->size - minLabel : 1;
+}
+
+static void trieBuilder_moveScanStart(TrieBuilder *builder) {
+    const Trie *trie = builder->trie;
+
+    if (builder->scanStart < builder->lastState - TRIE_BUILDER_SCAN_WINDOW) {
+        builder->scanStart = builder->lastState - TRIE_BUILDER_SCAN_WINDOW;
+    }
+
+    trieBuilder_reserveTrials(builder);
+    while (builder->scanStart < trie->size && (
+        trie_getCheck(trie, builder->scanStart) > 0 || builder->trials[builder->scanStart] >= TRIE_BUILDER_MAX_TRIALS
+    )) {
+        builder->scanStart++;
+    }
+}
+
+// a key alone in its range ends in tail right after its first own character, incremental insertion splits
+// the tail only when a later needle shares it, so with the tail the states differ from insertion
+static void trieBuilder_insertChild(
+        TrieBuilder *builder,
+        const TrieIndex state,
+        const TrieBase base,
+        const Character label,
+        const size_t from,
+        const size_t to,
+        const TrieNeedleIndex depth
+) {
+    Trie *trie = builder->trie;
+    const TrieIndex child = createState(label, base);
+    const TrieSortedKey *key = &builder->keys[from];
+    const UserData userData = builder->userData ? builder->userData[from] : emptyUserData;
+
+    if (to - from > 1 || !trie->options->useTail) {
+        trie_insertNode(trie, child, 1, state);
+        trieBuilder_enqueue(builder, (TrieBuilderNode){child, from, to, depth + 1});
+        return;
+    }
+
+    const TailCharIndex tailCharsLength = key->length - depth - 1;
+    if (likely(tailCharsLength > 0)) {
+        Character *chars = allocateCharacters(tailCharsLength);
+        memcpy(chars, key->characters + depth + 1, tailCharsLength * sizeof(Character));
+
+        trie_insertNode(trie, child, -tailBuilder_insertChars(trie->tailBuilder, tailCharsLength, chars), state);
+    } else {
+        trie_insertNode(trie, child, 1, state);
+        trieBuilder_enqueue(builder, (TrieBuilderNode){child, from, to, depth + 1});
+    }
+    trie_setNeedle(trie, child, userData, builder->ids[from]);
+}
+
+static void trieBuilder_placeChildren(TrieBuilder *builder, const TrieBuilderNode node) {
+    Trie *trie = builder->trie;
+    const TrieSortedKey *keys = builder->keys;
+    const bool hasEnd = keys[node.from].length == node.depth;
+    size_t labelCount = 0;
+
+    trieBuilder_reserveLabels(builder, node.to - node.from);
+
+    size_t i = node.from;
+    if (hasEnd) {
+        builder->labels[labelCount] = END_OF_TEXT;
+        builder->labelEnds[labelCount++] = ++i;
+    }
+    while (i < node.to) {
+        const Character label = keys[i].characters[node.depth];
+        while (++i < node.to && keys[i].characters[node.depth] == label);
+
+        builder->labels[labelCount] = label;
+        builder->labelEnds[labelCount++] = i;
+    }
+
+    const TrieBase base = trieBuilder_findBase(builder, labelCount);
+    trie_setBase(trie, node.state, base);
+
+    size_t from = node.from;
+    for (size_t l = 0; l < labelCount; l++) {
+        if (hasEnd && l == 0) {
+            const TrieIndex endState = createState(END_OF_TEXT, base);
+            trie_insertNode(trie, endState, base, node.state);
+            trie_setNeedle(trie, endState, builder->userData ? builder->userData[from] : emptyUserData, builder->ids[from]);
+        } else {
+            trieBuilder_insertChild(builder, node.state, base, builder->labels[l], from, builder->labelEnds[l], node.depth);
+        }
+        from = builder->labelEnds[l];
+
+        if (createState(builder->labels[l], base) > builder->lastState) {
+            builder->lastState = createState(builder->labels[l], base);
+        }
+    }
+
+    trieBuilder_moveScanStart(builder);
+}
+
+// needles are sorted and children of each state are placed once level by level, so no base is moved,
+// IDs are the same as with trie_addNeedle in order of the input, a duplicate keeps user data of its last occurrence
+Trie *createTrieFromNeedles(
+        TrieOptions *options,
+        TailBuilder *tailBuilder,
+        UserDataList *userDataList,
+        const size_t initialSize,
+        TrieNeedle *const *needles,
+        const UserData *data,
+        const size_t count,
+        NeedleId *needleIds
+) {
+    Trie *trie = createTrie(options, tailBuilder, userDataList, initialSize);
+    if (count == 0) {
+        return trie;
+    }
+
+    TrieKey *keys = safeAlloc(count * sizeof(TrieKey), "Trie keys");
+    TrieSortedKey *sortedKeys = safeAlloc(count * sizeof(TrieSortedKey), "Trie sorted keys");
+    for (size_t i = 0; i < count; i++) {
+        keys[i] = trie_createKey(trie, needles[i]);
+        sortedKeys[i] = (TrieSortedKey){keys[i].symbolNeedle->characters, keys[i].symbolNeedle->length, i};
+    }
+    qsort(sortedKeys, count, sizeof(TrieSortedKey), trieSortedKey_compare);
+
+    // duplicates are merged into the first one, which gets user data of the last one
+    size_t *uniqueIndices = safeAlloc(count * sizeof(size_t), "Trie unique indices");
+    NeedleId *ids = safeAlloc(count * sizeof(NeedleId), "Trie needle IDs");
+    UserData *userData = data ? safeAlloc(count * sizeof(UserData), "Trie user data") : NULL;
+    size_t uniqueCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (i == 0 || 0 != trieSortedKey_compareSymbols(&sortedKeys[i], &sortedKeys[uniqueCount - 1])) {
+            sortedKeys[uniqueCount] = sortedKeys[i];
+            ids[uniqueCount++] = NEEDLE_ID_NONE;
+        }
+        uniqueIndices[sortedKeys[i].index] = uniqueCount - 1;
+        if (userData) {
+            userData[uniqueCount - 1] = data[sortedKeys[i].index];
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const size_t unique = uniqueIndices[i];
+        if (ids[unique] == NEEDLE_ID_NONE) {
+            ids[unique] = trie->needleCount++;
+            if (trie->needleTable) {
+                needleTable_add(trie->needleTable, needles[i]);
+            }
+        }
+        if (needleIds) {
+            needleIds[i] = ids[unique];
+        }
+    }
+
+    TrieBuilder builder = {
+        .trie = trie,
+        .keys = sortedKeys,
+        .ids = ids,
+        .userData = userData,
+        .queue = safeAlloc(TRIE_BUILDER_QUEUE_INIT_SIZE * sizeof(TrieBuilderNode), "Trie builder queue"),
+        .queueSize = TRIE_BUILDER_QUEUE_INIT_SIZE,
+        .scanStart = TRIE_POOL_START + 1,
+        .lastState = TRIE_POOL_START,
+    };
+    trieBuilder_enqueue(&builder, (TrieBuilderNode){TRIE_POOL_START, 0, uniqueCount, 0});
+    while (builder.queueFront < builder.queueRear) {
+        trieBuilder_placeChildren(&builder, builder.queue[builder.queueFront++]);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        trieKey_free(keys[i]);
+    }
+    safeFree(builder.queue);
+    safeFree(builder.labels);
+    safeFree(builder.labelEnds);
+    safeFree(builder.trials);
+    safeFree(userData);
+    safeFree(ids);
+    safeFree(uniqueIndices);
+    safeFree(sortedKeys);
+    safeFree(keys);
+
+    return trie;
 }
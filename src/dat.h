@@ -4,13 +4,26 @@
 #include "../include/dat.h"
 #include "definitions.h"
 #include "list.h"
+#include "alphabet.h"
+#include "needle.h"
+#include "needle_table.h"
+#include "user_data.h"
 
 
+#define TRIE_ALPHABET_INIT_SIZE 64
+#define TRIE_BUILDER_QUEUE_INIT_SIZE 64
+#define TRIE_BUILDER_MAX_TRIALS 16
+#define TRIE_BUILDER_SCAN_WINDOW 4096
+
 typedef int32_t TrieIndex, TrieBase;
 
 typedef struct trieOptions {
     bool useTail: 1;
     bool useUserData: 1;
+    bool useByteAlphabet: 1;
+    bool useDenseAlphabet: 1;
+    bool useCaseFolding: 1;
+    bool useTailDeduplication: 1;
     size_t childListInitSize;
 } TrieOptions;
 
@@ -24,10 +37,49 @@ typedef struct trie {
     TrieOptions *options;
     TrieCell *cells;
     TrieIndex size;
+    NeedleId *needleIds;
+    NeedleId needleCount;
+    size_t maxNeedleLength;
     struct tailBuilder *tailBuilder;
     struct userDataList *userDataList;
+    Alphabet *alphabet;
+    NeedleTable *needleTable;
 } Trie;
 
+// needle converted to symbols of the trie, intermediate needles are owned by the key
+typedef struct {
+    TrieNeedle *folded, *bytes, *symbols;
+    const TrieNeedle *symbolNeedle;
+} TrieKey;
+
+typedef struct {
+    const Character *characters;
+    TrieNeedleIndex length;
+    size_t index; // position in the input of the bulk construction
+} TrieSortedKey;
+
+// state with its range of sorted keys, which share first depth symbols
+typedef struct {
+    TrieIndex state;
+    size_t from, to;
+    TrieNeedleIndex depth;
+} TrieBuilderNode;
+
+// bulk construction places children of each state once, states are processed level by level from the queue,
+// free cells tried too many times or far behind the last state are skipped by the scan start (left for insertion)
+typedef struct {
+    Trie *trie;
+    const TrieSortedKey *keys;
+    const NeedleId *ids;
+    const UserData *userData;
+    TrieBuilderNode *queue;
+    size_t queueSize, queueFront, queueRear;
+    Character *labels;
+    size_t *labelEnds, labelsSize;
+    unsigned char *trials;
+    TrieIndex trialsSize, scanStart, lastState;
+} TrieBuilder;
+
 
 TrieBase trie_getBase(const Trie *trie, TrieIndex index);
 TrieIndex trie_getCheck(const Trie *trie, TrieIndex index);
@@ -26,11 +26,13 @@
 #define unlikely(x) __builtin_expect(!!(x), 0)
 #define prefetch(addr, rw, locality) __builtin_prefetch((addr), (rw), (locality))
 #define add_overflow(a, b, result) __builtin_add_overflow((a), (b), (result))
+#define force_inline inline __attribute__((always_inline))
 #else
 #define likely(x) (x)
 #define unlikely(x) (x)
 #define prefetch(addr, rw, locality) (void)
 #define add_overflow(a, b, result) ({(*result) = (a) + (b); false;})
+#define force_inline inline
 #endif
 
 #endif
@@ -10,10 +10,32 @@
 
 
 enum fileHeader {
-    HAS_TAIL           = 0b01,
-    HAS_USER_DATA_LIST = 0b10,
+    HAS_TAIL             = 0b0001,
+    HAS_USER_DATA_LIST   = 0b0010,
+    HAS_TRANSITION_TABLE = 0b0100,
+    HAS_BYTE_ALPHABET    = 0b1000,
+    HAS_PREFILTER        = 0b10000,
+    HAS_SPLIT_CELLS      = 0b100000,
+    HAS_ALPHABET         = 0b1000000,
+    HAS_EXTENDED_HEADER  = 0b10000000,
 };
 
+// the last bit of the header announces 32 bits of further flags
+enum fileExtendedHeader {
+    HAS_NEEDLE_IDS        = 0b0001,
+    HAS_CASE_FOLDING      = 0b0010,
+    HAS_NEEDLE_TABLE      = 0b0100,
+    HAS_MAX_NEEDLE_LENGTH = 0b1000,
+    HAS_UNFOLDED_TAIL     = 0b10000,
+    HAS_TAIL_BYTES        = 0b100000,
+};
+
+#ifdef AUTOMATON_SPLIT_CELLS
+#define CELLS_LAYOUT HAS_SPLIT_CELLS
+#else
+#define CELLS_LAYOUT 0
+#endif
+
 
 static FILE *safeOpen(const char *filename, const char *mode);
 static void safeClose(FILE *file);
@@ -23,8 +45,21 @@ static void safeRead(void * restrict pointer, size_t size, size_t items, FILE *
 static void file_storeAutomaton(FILE * restrict file, const Automaton *automaton);
 static void file_storeTail(FILE * restrict file, const Tail *tail);
 static void file_storeUserDataList(FILE * restrict file, AutomatonIndex size, const UserDataList *userDataList);
-static Automaton *file_loadAutomaton(FILE * restrict file);
+static void file_storeTransitionTable(FILE * restrict file, const Automaton *automaton);
+static void file_storePrefilter(FILE * restrict file, const Prefilter *prefilter);
+static void file_storeAlphabet(FILE * restrict file, const Alphabet *alphabet);
+static void file_storeNeedleIds(FILE * restrict file, const Automaton *automaton);
+static void file_storeNeedleTable(FILE * restrict file, const NeedleTable *needleTable);
+static void file_storeMaxNeedleLength(FILE * restrict file, const Automaton *automaton);
+static Automaton *file_loadAutomaton(FILE * restrict file, bool isSplit);
+static void file_loadTransitionTable(FILE * restrict file, Automaton *automaton);
+static void file_loadPrefilter(FILE * restrict file, Prefilter *prefilter);
+static Alphabet *file_loadAlphabet(FILE * restrict file);
+static void file_loadNeedleIds(FILE * restrict file, Automaton *automaton);
+static NeedleTable *file_loadNeedleTable(FILE * restrict file);
+static void file_loadMaxNeedleLength(FILE * restrict file, Automaton *automaton);
 static Tail *file_loadTail(FILE * restrict file);
+static Tail *file_loadTailCharacters(FILE * restrict file);
 static UserDataList *file_loadUserDataList(FILE * restrict file, AutomatonIndex size);
 
 
@@ -58,12 +93,16 @@ static void safeClose(FILE *file) {
 }
 
 
+// cells are stored in the layout the library was built with, see HAS_SPLIT_CELLS
 static void file_storeAutomaton(FILE * restrict file, const Automaton *automaton) {
-    safeWrite((const void*) &automaton->size, sizeof(AutomatonIndex), 1, file);
+    const size_t size = (size_t) automaton->size;
 
-    for (AutomatonIndex i = 0; i < automaton->size; i++) {
-        safeWrite((const void*) &automaton->cells[i], sizeof(AutomatonCell), 1, file);
-    }
+    safeWrite((const void*) &automaton->size, sizeof(AutomatonIndex), 1, file);
+    safeWrite((const void*) automaton->cells, sizeof(AutomatonCell), size, file);
+#ifdef AUTOMATON_SPLIT_CELLS
+    safeWrite((const void*) automaton->fails, sizeof(AutomatonIndex), size, file);
+    safeWrite((const void*) automaton->outputs, sizeof(AutomatonIndex), size, file);
+#endif
 }
 
 static void file_storeTail(FILE * restrict file, const Tail *tail) {
@@ -75,69 +114,195 @@ static void file_storeTail(FILE * restrict file, const Tail *tail) {
     safeWrite((const void*) & tailSize, sizeof(TailIndex), 1, file);
 
     if (tailSize) {
-        for (TailIndex i = 1; i < tailSize; i++) {
-            const TailCell cell = tail->cells[i];
-
-            safeWrite((const void*) &cell.length, sizeof(TailCharIndex), 1, file);
-            safeWrite((const void*) cell.chars, sizeof(Character), (size_t) cell.length, file);
-        }
+        safeWrite((const void*) &tail->length, sizeof(TailCharIndex), 1, file);
+        safeWrite((const void*) tail->offsets, sizeof(TailCharIndex), (size_t) tailSize + 1, file);
+        safeWrite((const void*) tail->bytes, 1, tail->length, file);
     }
 }
 
 static void file_storeUserDataList(FILE * restrict file, const AutomatonIndex size, const UserDataList *userDataList) {
     for (AutomatonIndex i = 0; i < size; i++) {
         safeWrite((const void *) &userDataList->cells[i].size, sizeof(UserDataSize), 1, file);
-        safeWrite((const void *) userDataList->cells[i].value, 1, userDataList->cells[i].size, file);
+        if (userDataList->cells[i].size > 0) {
+            safeWrite((const void *) userDataList->cells[i].value, 1, userDataList->cells[i].size, file);
+        }
     }
 }
 
+static void file_storeTransitionTable(FILE * restrict file, const Automaton *automaton) {
+    safeWrite((const void*) &automaton->transitionClassCount, sizeof(int), 1, file);
+    safeWrite((const void*) automaton->transitionClasses, 1, TRANSITION_TABLE_ALPHABET, file);
+    safeWrite(
+        (const void*) automaton->transitions,
+        sizeof(AutomatonIndex),
+        (size_t) automaton->size * automaton->transitionClassCount,
+        file
+    );
+}
+
+static void file_storePrefilter(FILE * restrict file, const Prefilter *prefilter) {
+    safeWrite((const void*) prefilter, sizeof(Prefilter), 1, file);
+}
+
+static void file_storeAlphabet(FILE * restrict file, const Alphabet *alphabet) {
+    safeWrite((const void*) &alphabet->count, sizeof(Character), 1, file);
+    safeWrite((const void*) alphabet->characters, sizeof(Character), (size_t) alphabet->count, file);
+}
+
+static void file_storeNeedleIds(FILE * restrict file, const Automaton *automaton) {
+    safeWrite((const void*) automaton->needleIds, sizeof(NeedleId), (size_t) automaton->size, file);
+}
+
+static void file_storeNeedleTable(FILE * restrict file, const NeedleTable *needleTable) {
+    safeWrite((const void*) &needleTable->count, sizeof(NeedleId), 1, file);
+    safeWrite((const void*) &needleTable->length, sizeof(NeedleTableOffset), 1, file);
+    safeWrite((const void*) needleTable->offsets, sizeof(NeedleTableOffset), (size_t) needleTable->count + 1, file);
+    safeWrite((const void*) needleTable->bytes, 1, needleTable->length, file);
+}
+
+static void file_storeMaxNeedleLength(FILE * restrict file, const Automaton *automaton) {
+    const uint64_t maxNeedleLength = automaton->maxNeedleLength;
+    safeWrite((const void*) &maxNeedleLength, sizeof(uint64_t), 1, file);
+}
+
 void file_store(const char *targetPath, const Automaton *automaton, const Tail *tail, const UserDataList *userDataList) {
     FILE *file = safeOpen(targetPath, "w+b");
 
-    unsigned char header = (tail? HAS_TAIL : 0) | (userDataList ? HAS_USER_DATA_LIST : 0);
+    unsigned char header = (tail? HAS_TAIL : 0)
+        | (userDataList ? HAS_USER_DATA_LIST : 0)
+        | (automaton->transitions ? HAS_TRANSITION_TABLE : 0)
+        | (automaton->useByteAlphabet ? HAS_BYTE_ALPHABET : 0)
+        | (automaton->prefilter.isEnabled ? HAS_PREFILTER : 0)
+        | (automaton->alphabet ? HAS_ALPHABET : 0)
+        | CELLS_LAYOUT
+        | HAS_EXTENDED_HEADER;
+    const uint32_t extendedHeader = HAS_NEEDLE_IDS
+        | HAS_MAX_NEEDLE_LENGTH
+        | HAS_TAIL_BYTES
+        | (automaton->useCaseFolding ? HAS_CASE_FOLDING : 0)
+        | (automaton->needleTable ? HAS_NEEDLE_TABLE : 0)
+        | (automaton->unfoldedStart < automaton->size ? HAS_UNFOLDED_TAIL : 0);
     safeWrite((const void*) &header, 1, 1, file);
+    safeWrite((const void*) &extendedHeader, sizeof(uint32_t), 1, file);
+    if (extendedHeader & HAS_UNFOLDED_TAIL) {
+        safeWrite((const void*) &automaton->unfoldedStart, sizeof(AutomatonIndex), 1, file);
+    }
 
     file_storeAutomaton(file, automaton);
     if (tail) {
         file_storeTail(file, tail);
     }
     if (userDataList) {
-        file_storeUserDataList(file, automaton->size, userDataList);
+        file_storeUserDataList(file, automaton->unfoldedStart, userDataList);
+    }
+    if (automaton->transitions) {
+        file_storeTransitionTable(file, automaton);
     }
+    if (automaton->prefilter.isEnabled) {
+        file_storePrefilter(file, &automaton->prefilter);
+    }
+    if (automaton->alphabet) {
+        file_storeAlphabet(file, automaton->alphabet);
+    }
+    file_storeNeedleIds(file, automaton);
+    if (automaton->needleTable) {
+        file_storeNeedleTable(file, automaton->needleTable);
+    }
+    file_storeMaxNeedleLength(file, automaton);
 
     safeClose(file);
 }
 
 
-static Automaton *file_loadAutomaton(FILE * restrict file) {
+static Automaton *file_loadAutomaton(FILE * restrict file, const bool isSplit) {
     AutomatonIndex automatonSize;
     safeRead((void*) &automatonSize, sizeof(AutomatonIndex), 1, file);
 
     Automaton *automaton = createAutomaton(automatonSize);
-    for (AutomatonIndex i = 0; i < automatonSize; i++) {
-        safeRead((void*) &automaton->cells[i], sizeof(AutomatonCell), 1, file);
+    const size_t size = (size_t) automatonSize;
+
+#ifdef AUTOMATON_SPLIT_CELLS
+    if (isSplit) {
+        safeRead((void*) automaton->cells, sizeof(AutomatonCell), size, file);
+        safeRead((void*) automaton->fails, sizeof(AutomatonIndex), size, file);
+        safeRead((void*) automaton->outputs, sizeof(AutomatonIndex), size, file);
+    } else {
+        AutomatonIndex cell[4];
+        for (size_t i = 0; i < size; i++) {
+            safeRead((void*) cell, sizeof(AutomatonIndex), 4, file);
+            automaton->cells[i] = (AutomatonCell) {cell[0], cell[1]};
+            automaton->fails[i] = cell[2];
+            automaton->outputs[i] = cell[3];
+        }
     }
+#else
+    if (isSplit) {
+        for (size_t i = 0; i < size; i++) {
+            safeRead((void*) &automaton->cells[i].base, sizeof(AutomatonIndex), 1, file);
+            safeRead((void*) &automaton->cells[i].check, sizeof(AutomatonIndex), 1, file);
+        }
+        for (size_t i = 0; i < size; i++) {
+            safeRead((void*) &automaton->cells[i].fail, sizeof(AutomatonIndex), 1, file);
+        }
+        for (size_t i = 0; i < size; i++) {
+            safeRead((void*) &automaton->cells[i].output, sizeof(AutomatonIndex), 1, file);
+        }
+    } else {
+        safeRead((void*) automaton->cells, sizeof(AutomatonCell), size, file);
+    }
+#endif
 
     return automaton;
 }
 
 static Tail *file_loadTail(FILE * restrict file) {
     TailIndex tailSize;
+    TailCharIndex length;
     safeRead(&tailSize, sizeof(TailIndex), 1, file);
+    safeRead(&length, sizeof(TailCharIndex), 1, file);
 
-    Tail *tail = createTail(tailSize);
-    tail->cells[0] = (TailCell) {NULL,0};
+    Tail *tail = createTail(tailSize, length);
+    safeRead((void*) tail->offsets, sizeof(TailCharIndex), (size_t) tailSize + 1, file);
+    safeRead((void*) tail->bytes, 1, length, file);
 
-    for (TailIndex i = 0; i < tailSize - 1; i++) {
-        const TailIndex index = i + 1;
-        TailCell cell;
+    return tail;
+}
+
+// files without tail bytes store characters of each cell, they are encoded to UTF-8 while loading
+static Tail *file_loadTailCharacters(FILE * restrict file) {
+    TailIndex tailSize;
+    safeRead(&tailSize, sizeof(TailIndex), 1, file);
 
-        safeRead((void*) &cell.length, sizeof(TailCharIndex), 1, file);
-        cell.chars = allocateCharacters(cell.length);
-        safeRead((void*) cell.chars, sizeof(Character), (size_t) cell.length, file);
+    size_t capacity = (size_t) tailSize;
+    Tail *tail = createTail(tailSize, capacity);
+    Character *chars = NULL;
+    TailCharIndex charsCapacity = 0, length = 0;
 
-        tail->cells[index] = cell;
+    tail->offsets[0] = 0;
+    for (TailIndex i = 1; i < tailSize; i++) {
+        TailCharIndex charsLength;
+        safeRead((void*) &charsLength, sizeof(TailCharIndex), 1, file);
+
+        if (charsLength > charsCapacity) {
+            safeFree(chars);
+            chars = allocateCharacters(charsLength);
+            charsCapacity = charsLength;
+        }
+        safeRead((void*) chars, sizeof(Character), (size_t) charsLength, file);
+
+        const size_t needed = (size_t) length + (size_t) charsLength * UTF8_MAX_LENGTH;
+        if (needed > capacity) {
+            const size_t newCapacity = calculateAllocation(needed);
+            tail->bytes = safeRealloc(tail->bytes, capacity, newCapacity, sizeof(char), "Tail bytes");
+            capacity = newCapacity;
+        }
+
+        tail->offsets[i] = length;
+        length = tail_encodeCharacters(tail->bytes, length, charsLength, chars);
     }
+    tail->offsets[tailSize] = length;
+    tail->length = length;
+    safeFree(chars);
 
     return tail;
 }
@@ -147,6 +312,9 @@ static UserDataList *file_loadUserDataList(FILE * restrict file, const Automaton
 
     for (AutomatonIndex i = 0; i < size; i++) {
         safeRead((void*) &userDataList->cells[i].size, sizeof(UserDataSize), 1, file);
+        if (userDataList->cells[i].size <= 0) {
+            continue;
+        }
         userDataList->cells[i].value = safeAlloc(userDataList->cells[i].size, "user data");
         safeRead((void*) userDataList->cells[i].value, 1, userDataList->cells[i].size, file);
     }
@@ -154,6 +322,63 @@ static UserDataList *file_loadUserDataList(FILE * restrict file, const Automaton
     return userDataList;
 }
 
+static void file_loadTransitionTable(FILE * restrict file, Automaton *automaton) {
+    safeRead((void*) &automaton->transitionClassCount, sizeof(int), 1, file);
+    safeRead((void*) automaton->transitionClasses, 1, TRANSITION_TABLE_ALPHABET, file);
+
+    automaton->transitions = createTransitionTable(automaton->size, automaton->transitionClassCount);
+    safeRead(
+        (void*) automaton->transitions,
+        sizeof(AutomatonIndex),
+        (size_t) automaton->size * automaton->transitionClassCount,
+        file
+    );
+}
+
+static void file_loadPrefilter(FILE * restrict file, Prefilter *prefilter) {
+    safeRead((void*) prefilter, sizeof(Prefilter), 1, file);
+}
+
+// symbols are given in order of insertion, so adding stored characters in their order restores the map
+static Alphabet *file_loadAlphabet(FILE * restrict file) {
+    Character count;
+    safeRead((void*) &count, sizeof(Character), 1, file);
+
+    Alphabet *alphabet = createAlphabet(count ?: 1);
+    for (Character i = 0; i < count; i++) {
+        Character character;
+        safeRead((void*) &character, sizeof(Character), 1, file);
+        alphabet_addCharacter(alphabet, character);
+    }
+
+    return alphabet;
+}
+
+static void file_loadNeedleIds(FILE * restrict file, Automaton *automaton) {
+    safeRead((void*) automaton->needleIds, sizeof(NeedleId), (size_t) automaton->size, file);
+}
+
+static NeedleTable *file_loadNeedleTable(FILE * restrict file) {
+    NeedleId count;
+    NeedleTableOffset length;
+    safeRead((void*) &count, sizeof(NeedleId), 1, file);
+    safeRead((void*) &length, sizeof(NeedleTableOffset), 1, file);
+
+    NeedleTable *needleTable = createNeedleTable(length, count);
+    safeRead((void*) needleTable->offsets, sizeof(NeedleTableOffset), (size_t) count + 1, file);
+    safeRead((void*) needleTable->bytes, 1, length, file);
+    needleTable->count = count;
+    needleTable->length = length;
+
+    return needleTable;
+}
+
+static void file_loadMaxNeedleLength(FILE * restrict file, Automaton *automaton) {
+    uint64_t maxNeedleLength;
+    safeRead((void*) &maxNeedleLength, sizeof(uint64_t), 1, file);
+    automaton->maxNeedleLength = (size_t) maxNeedleLength;
+}
+
 FileData file_load(const char *targetPath) {
     if (unlikely(0 != access(targetPath, F_OK))) {
         error("file does not exists");
@@ -164,10 +389,49 @@ FileData file_load(const char *targetPath) {
     unsigned char header;
     safeRead(&header, 1, 1, file);
 
+    uint32_t extendedHeader = 0;
+    if (header & HAS_EXTENDED_HEADER) {
+        safeRead(&extendedHeader, sizeof(uint32_t), 1, file);
+    }
+
+    AutomatonIndex unfoldedStart = 0;
+    if (extendedHeader & HAS_UNFOLDED_TAIL) {
+        safeRead(&unfoldedStart, sizeof(AutomatonIndex), 1, file);
+    }
+
     FileData fileData;
-    fileData.automaton = file_loadAutomaton(file);
-    fileData.tail = header & HAS_TAIL ? file_loadTail(file) : NULL;
-    fileData.userDataList = header & HAS_USER_DATA_LIST ? file_loadUserDataList(file, fileData.automaton->size) : NULL;
+    fileData.automaton = file_loadAutomaton(file, header & HAS_SPLIT_CELLS);
+    fileData.automaton->useByteAlphabet = header & HAS_BYTE_ALPHABET;
+    if (extendedHeader & HAS_UNFOLDED_TAIL) {
+        fileData.automaton->unfoldedStart = unfoldedStart;
+    }
+    fileData.tail = NULL;
+    if (header & HAS_TAIL) {
+        fileData.tail = extendedHeader & HAS_TAIL_BYTES ? file_loadTail(file) : file_loadTailCharacters(file);
+    }
+    fileData.userDataList = header & HAS_USER_DATA_LIST ? file_loadUserDataList(file, fileData.automaton->unfoldedStart) : NULL;
+    if (header & HAS_TRANSITION_TABLE) {
+        file_loadTransitionTable(file, fileData.automaton);
+    }
+    if (header & HAS_PREFILTER) {
+        file_loadPrefilter(file, &fileData.automaton->prefilter);
+    }
+    if (header & HAS_ALPHABET) {
+        fileData.automaton->alphabet = file_loadAlphabet(file);
+    }
+    if (extendedHeader & HAS_NEEDLE_IDS) {
+        file_loadNeedleIds(file, fileData.automaton);
+    }
+    fileData.automaton->useCaseFolding = extendedHeader & HAS_CASE_FOLDING;
+    if (extendedHeader & HAS_NEEDLE_TABLE) {
+        fileData.automaton->needleTable = file_loadNeedleTable(file);
+    }
+    automaton_buildDepths(fileData.automaton);
+    if (extendedHeader & HAS_MAX_NEEDLE_LENGTH) {
+        file_loadMaxNeedleLength(file, fileData.automaton);
+    } else {
+        automaton_buildMaxNeedleLength(fileData.automaton, fileData.tail);
+    }
 
     safeClose(file);
 
@@ -87,8 +87,8 @@ static void list_poolInit(List *list, const ListIndex fromIndex, const ListIndex
 }
 
 void list_free(List *list) {
-    free(list->cells);
-    free(list);
+    safeFree(list->cells);
+    safeFree(list);
     list = NULL;
 }
 
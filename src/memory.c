@@ -12,18 +12,61 @@
 
 
 static void allocError(const char *message);
+static void *defaultMalloc(size_t size, void *userData);
+static void *defaultRealloc(void *pointer, size_t size, void *userData);
+static void defaultFree(void *pointer, void *userData);
+static void *defaultAlignedAlloc(size_t alignment, size_t size, void *userData);
 
 
+static Allocator allocator = {defaultMalloc, defaultRealloc, defaultFree, defaultAlignedAlloc, NULL};
+
+
+static void *defaultMalloc(const size_t size, void *userData) {
+    unused(userData);
+    return malloc(size);
+}
+
+static void *defaultRealloc(void *pointer, const size_t size, void *userData) {
+    unused(userData);
+    return realloc(pointer, size);
+}
+
+static void defaultFree(void *pointer, void *userData) {
+    unused(userData);
+    free(pointer);
+}
+
+// size of aligned allocation must be a multiple of the alignment
+static void *defaultAlignedAlloc(const size_t alignment, const size_t size, void *userData) {
+    unused(userData);
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+// allocator must be set before anything is allocated, memory is freed by the allocator which allocated it
+void memory_setAllocator(const Allocator *newAllocator) {
+    if (NULL == newAllocator) {
+        allocator = (Allocator) {defaultMalloc, defaultRealloc, defaultFree, defaultAlignedAlloc, NULL};
+        return;
+    }
+
+    allocator = (Allocator) {
+        newAllocator->malloc ?: defaultMalloc,
+        newAllocator->realloc ?: defaultRealloc,
+        newAllocator->free ?: defaultFree,
+        newAllocator->alignedAlloc,
+        newAllocator->userData,
+    };
+}
+
 static void allocError(const char *message) {
     puts(message);
     error("can not allocate memory");
 }
 
 void *safeAlloc(const size_t neededSize, const char *message) {
-    void *pointer = aligned_alloc(
-            CACHE_LINE_SIZE,
-            (size_t) ceil((double) neededSize / CACHE_LINE_SIZE) * CACHE_LINE_SIZE
-    );
+    void *pointer = allocator.alignedAlloc
+        ? allocator.alignedAlloc(CACHE_LINE_SIZE, neededSize, allocator.userData)
+        : allocator.malloc(neededSize, allocator.userData);
 
     if (unlikely(!pointer)) {
         allocError(message);
@@ -32,21 +75,37 @@ void *safeAlloc(const size_t neededSize, const char *message) {
     return pointer;
 }
 
+// without aligned allocation buffers are resized by the allocator, so they can grow in place,
+// aligned buffers are resized by the default realloc only while it keeps them aligned, otherwise they are copied,
+// so realloc callback never gets a block from the aligned allocation
 void *safeRealloc(void *pointer, const size_t oldCount, const size_t newCount, const size_t size, const char *message) {
-    void *newPointer;
-    if (newCount <= oldCount) {
-        newPointer = realloc(pointer, newCount * size);
-    } else {
-        newPointer = safeAlloc(newCount * size, message);
-        memcpy(newPointer, pointer, oldCount * size);
-        free(pointer);
+    const bool isDefault = allocator.realloc == defaultRealloc && allocator.alignedAlloc == defaultAlignedAlloc;
+    void *newPointer = pointer;
+
+    if (NULL == allocator.alignedAlloc || isDefault) {
+        newPointer = allocator.realloc(pointer, newCount * size, allocator.userData);
+        if (unlikely(!newPointer && newCount * size > 0)) {
+            allocError(message);
+        }
+        if (NULL == allocator.alignedAlloc || 0 == (uintptr_t)newPointer % CACHE_LINE_SIZE) {
+            return newPointer;
+        }
     }
 
-    if (unlikely(!pointer)) {
+    void *alignedPointer = allocator.alignedAlloc(CACHE_LINE_SIZE, newCount * size, allocator.userData);
+    if (unlikely(!alignedPointer && newCount * size > 0)) {
         allocError(message);
     }
+    if (NULL != newPointer) {
+        memcpy(alignedPointer, newPointer, (isDefault || oldCount > newCount ? newCount : oldCount) * size);
+        allocator.free(newPointer, allocator.userData);
+    }
+
+    return alignedPointer;
+}
 
-    return newPointer;
+void safeFree(void *pointer) {
+    allocator.free(pointer, allocator.userData);
 }
 
 void resetMemory(void *pointer, const size_t size) {
@@ -2,10 +2,14 @@
 #define MEMORY_H
 
 #include <stdlib.h>
+#include "../include/memory.h"
 #include "definitions.h"
 
+typedef struct allocator Allocator;
+
 void *safeAlloc(size_t size, const char *message);
 void *safeRealloc(void *pointer, size_t oldCount, size_t newCount, size_t size, const char *message);
+void safeFree(void *pointer);
 void resetMemory(void *pointer, size_t size);
 size_t calculateAllocation(size_t currentSize);
 
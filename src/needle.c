@@ -1,11 +1,23 @@
 #include <stdlib.h>
+#include <string.h>
 #include "needle.h"
 #include "memory.h"
 
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(NO_SIMD)
+#define UTF8_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
 
 static inline char utf8Fill(Character unicode, int number, int shift);
 static inline bool utf8Validate(unsigned char byte);
 static inline Character unicodeFill(unsigned char byte, int number, int shift);
+static size_t utf8DecodeAscii(const unsigned char *bytes, size_t length, Character *output);
+static inline size_t utf8DecodeAscii_scalar(const unsigned char *bytes, size_t length, Character *output, size_t index);
+#ifdef UTF8_SIMD_X86
+static size_t utf8DecodeAscii_sse2(const unsigned char *bytes, size_t length, Character *output);
+static size_t utf8DecodeAscii_avx2(const unsigned char *bytes, size_t length, Character *output);
+#endif
 
 
 typedef struct {
@@ -70,13 +82,22 @@ void unicodeToUtf8(const Character unicode, const int length, char *output, cons
 
 
 static inline bool utf8Validate(const unsigned char byte) {
-    return (byte & ~utf8MaskMap[0]->mask) != utf8MaskMap[0]->lead;
+    return !isUtf8Continuation(byte);
+}
+
+bool isUtf8Continuation(const unsigned char byte) {
+    return (byte & ~utf8MaskMap[0]->mask) == utf8MaskMap[0]->lead;
 }
 
 static inline Character unicodeFill(const unsigned char byte, int number, const int shift) {
     return (byte & utf8MaskMap[number]->mask) << shift;
 }
 
+// overlong forms, surrogates and code points above the Unicode range are not valid
+bool unicodeIsValid(const Character unicode, const int length) {
+    return unicodeLength(unicode) == length && (unicode < 0xD800 || unicode > 0xDFFF);
+}
+
 Character utf8ToUnicode(const char *needle, const int index, const int length) {
     const char bites = utf8MaskMap[0]->bites;
     Character unicode = unicodeFill((unsigned char)needle[index], length, (length - 1) * bites);
@@ -93,51 +114,352 @@ Character utf8ToUnicode(const char *needle, const int index, const int length) {
 }
 
 
-TrieNeedle *createTrieNeedle(const char *needle) {
-    TrieNeedle *trieNeedle = safeAlloc(sizeof(TrieNeedle), "needle");
-    trieNeedle->length = 0;
-    int index, length;
+static inline size_t utf8DecodeAscii_scalar(const unsigned char *bytes, const size_t length, Character *output, size_t index) {
+    while (index < length && bytes[index] < 0x80) {
+        output[index] = bytes[index];
+        index++;
+    }
+
+    return index;
+}
+
+#ifdef UTF8_SIMD_X86
+static size_t utf8DecodeAscii_sse2(const unsigned char *bytes, const size_t length, Character *output) {
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t index = 0;
+    for (; index + 16 <= length; index += 16) {
+        const __m128i chunk = _mm_loadu_si128((const __m128i *)(bytes + index));
+        if (_mm_movemask_epi8(chunk)) {
+            break;
+        }
+
+        const __m128i low = _mm_unpacklo_epi8(chunk, zero);
+        const __m128i high = _mm_unpackhi_epi8(chunk, zero);
+
+        _mm_storeu_si128((__m128i *)(output + index), _mm_unpacklo_epi16(low, zero));
+        _mm_storeu_si128((__m128i *)(output + index + 4), _mm_unpackhi_epi16(low, zero));
+        _mm_storeu_si128((__m128i *)(output + index + 8), _mm_unpacklo_epi16(high, zero));
+        _mm_storeu_si128((__m128i *)(output + index + 12), _mm_unpackhi_epi16(high, zero));
+    }
+
+    return utf8DecodeAscii_scalar(bytes, length, output, index);
+}
+
+__attribute__((target("avx2")))
+static size_t utf8DecodeAscii_avx2(const unsigned char *bytes, const size_t length, Character *output) {
+    size_t index = 0;
+    for (; index + 32 <= length; index += 32) {
+        const __m256i chunk = _mm256_loadu_si256((const __m256i *)(bytes + index));
+        if (_mm256_movemask_epi8(chunk)) {
+            break;
+        }
+
+        for (size_t part = 0; part < 32; part += 8) {
+            const __m128i eight = _mm_loadl_epi64((const __m128i *)(bytes + index + part));
+            _mm256_storeu_si256((__m256i *)(output + index + part), _mm256_cvtepu8_epi32(eight));
+        }
+    }
+
+    return index + utf8DecodeAscii_sse2(bytes + index, length - index, output + index);
+}
+#endif
+
+// decodes leading run of ASCII bytes, whole vectors at once when the CPU supports it
+static size_t utf8DecodeAscii(const unsigned char *bytes, const size_t length, Character *output) {
+#ifdef UTF8_SIMD_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return utf8DecodeAscii_avx2(bytes, length, output);
+    }
+    return utf8DecodeAscii_sse2(bytes, length, output);
+#else
+    return utf8DecodeAscii_scalar(bytes, length, output, 0);
+#endif
+}
+
+Utf8Decoded utf8Decode(const char *text, const size_t length, Character *output, const size_t capacity) {
+    const unsigned char *bytes = (const unsigned char *)text;
+    Utf8Decoded decoded = {0, 0, true};
 
-    index = 0;
-    while (needle[index] != '\0') {
-        length = utf8Length((unsigned char)needle[index]);
+    while (decoded.length < length && decoded.characters < capacity) {
+        const size_t available = length - decoded.length;
+        const size_t space = capacity - decoded.characters;
+        const size_t ascii = utf8DecodeAscii(bytes + decoded.length, available < space ? available : space, output + decoded.characters);
 
-        if (unlikely(!length)) {
-            return NULL;
+        decoded.length += ascii;
+        decoded.characters += ascii;
+        if (decoded.length == length || decoded.characters == capacity) {
+            break;
         }
 
-        index += length;
-        trieNeedle->length++;
+        const int u8Length = utf8Length(bytes[decoded.length]);
+        if (unlikely(!u8Length)) {
+            decoded.isValid = false;
+            break;
+        }
+        if (unlikely(decoded.length + u8Length > length)) {
+            break;
+        }
+
+        const Character unicode = utf8ToUnicode(text + decoded.length, 0, u8Length);
+        if (unlikely(!unicode || !unicodeIsValid(unicode, u8Length))) {
+            decoded.isValid = false;
+            break;
+        }
+
+        output[decoded.characters++] = unicode;
+        decoded.length += u8Length;
+    }
+
+    return decoded;
+}
+
+// measures the longest valid prefix of complete characters without decoding them
+Utf8Decoded utf8Check(const char *text, const size_t length) {
+    const unsigned char *bytes = (const unsigned char *)text;
+    Utf8Decoded checked = {0, 0, true};
+
+    while (checked.length < length) {
+#ifdef UTF8_SIMD_X86
+        while (checked.length + 16 <= length && !_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(bytes + checked.length)))) {
+            checked.length += 16;
+            checked.characters += 16;
+        }
+        if (checked.length == length) {
+            break;
+        }
+#endif
+        const int u8Length = utf8Length(bytes[checked.length]);
+        if (unlikely(!u8Length || checked.length + u8Length > length)) {
+            checked.isValid = false;
+            break;
+        }
+
+        const Character unicode = utf8ToUnicode(text + checked.length, 0, u8Length);
+        if (unlikely((!unicode && u8Length > 1) || !unicodeIsValid(unicode, u8Length))) {
+            checked.isValid = false;
+            break;
+        }
+
+        checked.length += u8Length;
+        checked.characters++;
+    }
+
+    return checked;
+}
+
+// counts characters as bytes which are not continuation bytes, text is not validated
+size_t utf8CountCharacters(const char *text, const size_t length) {
+    const unsigned char *bytes = (const unsigned char *)text;
+    size_t characters = 0, index = 0;
+
+#ifdef UTF8_SIMD_X86
+    const __m128i mask = _mm_set1_epi8((char)~utf8MaskMap[0]->mask);
+    const __m128i lead = _mm_set1_epi8((char)utf8MaskMap[0]->lead);
+
+    for (; index + 16 <= length; index += 16) {
+        const __m128i chunk = _mm_loadu_si128((const __m128i *)(bytes + index));
+        const int continuations = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(chunk, mask), lead));
+        characters += 16 - (size_t)__builtin_popcount((unsigned int)continuations);
+    }
+#endif
+
+    for (; index < length; index++) {
+        characters += !isUtf8Continuation(bytes[index]);
+    }
+
+    return characters;
+}
+
+// simple case folding of latin, greek, cyrillic, armenian and fullwidth latin letters,
+// mappings which would change UTF8 length of the character (e.g. long s or kelvin sign) are left out
+Character unicodeFold(const Character unicode) {
+    if (unicode < 0x80) {
+        return asciiFold(unicode);
     }
+    if (unicode < 0x100) {
+        if (unicode == 0xB5) {
+            return 0x3BC;
+        }
+        return unicode >= 0xC0 && unicode <= 0xDE && unicode != 0xD7 ? unicode + 0x20 : unicode;
+    }
+    if (unicode < 0x180) {
+        if (unicode == 0x130 || unicode == 0x131 || unicode == 0x138 || unicode == 0x149 || unicode == 0x17F) {
+            return unicode;
+        }
+        if (unicode == 0x178) {
+            return 0xFF;
+        }
+        const bool isOddUpper = (unicode >= 0x139 && unicode <= 0x148) || unicode >= 0x179;
+        return (unicode & 1) == isOddUpper ? unicode + 1 : unicode;
+    }
+    if (unicode >= 0x386 && unicode <= 0x3AB) {
+        if (unicode == 0x386) {
+            return 0x3AC;
+        }
+        if (unicode <= 0x38A) {
+            return unicode >= 0x388 ? unicode + 0x25 : unicode;
+        }
+        if (unicode == 0x38C) {
+            return 0x3CC;
+        }
+        if (unicode <= 0x38F) {
+            return unicode >= 0x38E ? unicode + 0x3F : unicode;
+        }
+        return unicode >= 0x391 && unicode != 0x3A2 ? unicode + 0x20 : unicode;
+    }
+    if (unicode == 0x3C2) {
+        return 0x3C3;
+    }
+    if (unicode >= 0x400 && unicode <= 0x52F) {
+        if (unicode < 0x410) {
+            return unicode + 0x50;
+        }
+        if (unicode < 0x430) {
+            return unicode + 0x20;
+        }
+        if (unicode == 0x4C0) {
+            return 0x4CF;
+        }
+        if (unicode >= 0x4C1 && unicode <= 0x4CE) {
+            return unicode & 1 ? unicode + 1 : unicode;
+        }
+        const bool isPaired = (unicode >= 0x460 && unicode <= 0x481) || (unicode >= 0x48A && unicode <= 0x4BF) || unicode >= 0x4D0;
+        return isPaired && !(unicode & 1) ? unicode + 1 : unicode;
+    }
+    if (unicode >= 0x531 && unicode <= 0x556) {
+        return unicode + 0x30;
+    }
+    if ((unicode >= 0x1E00 && unicode <= 0x1E95) || (unicode >= 0x1EA0 && unicode <= 0x1EFF)) {
+        return unicode & 1 ? unicode : unicode + 1;
+    }
+    if (unicode >= 0xFF21 && unicode <= 0xFF3A) {
+        return unicode + 0x20;
+    }
+
+    return unicode;
+}
 
-    trieNeedle->characters = safeAlloc(trieNeedle->length * sizeof(Character), "needle characters");
+// letters, digits and underscore; other characters are approximated by blocks of punctuation, symbols and spaces
+bool isWordCharacter(const Character unicode) {
+    if (unicode < 0x80) {
+        return (u_int32_t)((unicode | 0x20) - 'a') < 26 || (u_int32_t)(unicode - '0') < 10 || unicode == '_';
+    }
+    if (unicode < 0xC0) {
+        return unicode == 0xAA || unicode == 0xB5 || unicode == 0xBA;
+    }
+    if (unicode == 0xD7 || unicode == 0xF7) {
+        return false;
+    }
 
-    index = 0;
-    for (TrieNeedleIndex i = 0; i < trieNeedle->length; i++) {
-        length = utf8Length((unsigned char)needle[index]);
-        const Character unicode = utf8ToUnicode(needle, index, length);
+    return !((unicode >= 0x2000 && unicode <= 0x2BFF)
+        || (unicode >= 0x3000 && unicode <= 0x303F)
+        || (unicode >= 0xFE30 && unicode <= 0xFE4F)
+        || (unicode >= 0xFF00 && unicode <= 0xFF0F)
+        || (unicode >= 0xFF1A && unicode <= 0xFF20)
+        || (unicode >= 0xFF3B && unicode <= 0xFF40)
+        || (unicode >= 0xFF5B && unicode <= 0xFF65)
+        || (unicode >= 0x1F000 && unicode <= 0x1FAFF));
+}
 
-        if (unlikely(!unicode)) {
-            return NULL;
+// character which ends right before the index, zero at the start of the text or for invalid UTF8
+Character utf8CharacterBefore(const char *text, const size_t index) {
+    size_t start = index;
+    while (start > 0 && index - start < 4) {
+        start--;
+        if (!isUtf8Continuation((unsigned char)text[start])) {
+            break;
         }
+    }
+
+    const int u8Length = utf8Length((unsigned char)text[start]);
+    return start < index && (size_t)u8Length == index - start ? utf8ToUnicode(text + start, 0, u8Length) : 0;
+}
 
-        trieNeedle->characters[i] = unicode;
-        index += length;
+// character which starts at the index, zero at the end of the text or for invalid UTF8
+Character utf8CharacterAt(const char *text, const size_t length, const size_t index) {
+    if (index >= length) {
+        return 0;
     }
 
+    const int u8Length = utf8Length((unsigned char)text[index]);
+    return u8Length && index + u8Length <= length ? utf8ToUnicode(text + index, 0, u8Length) : 0;
+}
+
+TrieNeedle *trieNeedle_fold(const TrieNeedle *needle, const bool isAsciiOnly) {
+    TrieNeedle *foldedNeedle = safeAlloc(sizeof(TrieNeedle), "folded needle");
+    foldedNeedle->length = needle->length;
+    foldedNeedle->characters = safeAlloc(needle->length * sizeof(Character), "folded needle characters");
+
+    for (TrieNeedleIndex i = 0; i < needle->length; i++) {
+        const Character character = needle->characters[i];
+        foldedNeedle->characters[i] = isAsciiOnly ? asciiFold(character) : unicodeFold(character);
+    }
+
+    return foldedNeedle;
+}
+
+
+TrieNeedle *createTrieNeedle(const char *needle) {
+    const size_t length = strlen(needle);
+    Character *characters = safeAlloc(length * sizeof(Character), "needle characters");
+
+    const Utf8Decoded decoded = utf8Decode(needle, length, characters, length);
+    if (unlikely(!decoded.isValid || decoded.length != length)) {
+        safeFree(characters);
+        return NULL;
+    }
+
+    TrieNeedle *trieNeedle = safeAlloc(sizeof(TrieNeedle), "needle");
+    trieNeedle->characters = characters;
+    trieNeedle->length = (TrieNeedleIndex)decoded.characters;
+
     return trieNeedle;
 }
 
+TrieNeedle *trieNeedle_toBytes(const TrieNeedle *needle) {
+    TrieNeedle *byteNeedle = safeAlloc(sizeof(TrieNeedle), "byte needle");
+    byteNeedle->length = 0;
+
+    for (TrieNeedleIndex i = 0; i < needle->length; i++) {
+        byteNeedle->length += unicodeLength(needle->characters[i]);
+    }
+
+    byteNeedle->characters = safeAlloc(byteNeedle->length * sizeof(Character), "byte needle characters");
+
+    char bytes[4];
+    TrieNeedleIndex index = 0;
+    for (TrieNeedleIndex i = 0; i < needle->length; i++) {
+        const int length = unicodeLength(needle->characters[i]);
+        unicodeToUtf8(needle->characters[i], length, bytes, 0);
+
+        for (int b = 0; b < length; b++) {
+            byteNeedle->characters[index++] = (unsigned char)bytes[b];
+        }
+    }
+
+    return byteNeedle;
+}
+
 size_t trieNeedle_getLength(const TrieNeedle *needle) {
     return (size_t)needle->length;
 }
 
+size_t trieNeedle_getUtf8Length(const TrieNeedle *needle) {
+    size_t length = 0;
+    for (TrieNeedleIndex i = 0; i < needle->length; i++) {
+        length += unicodeLength(needle->characters[i]);
+    }
+
+    return length;
+}
+
 void trieNeedle_free(TrieNeedle *needle) {
-    free(needle->characters);
-    free(needle);
+    safeFree(needle->characters);
+    safeFree(needle);
     needle = NULL;
 }
 
 void needle_free(Needle *needle) {
-    free(needle);
+    safeFree(needle);
 }
@@ -2,19 +2,49 @@
 #define NEEDLE_H
 
 #include "../include/needle.h"
+#include "definitions.h"
 
 typedef u_int32_t TrieNeedleIndex;
+typedef int32_t NeedleId;
+
+#define UNICODE_FOLD_LAST 0xFFFF
+#define UTF8_MAX_LENGTH 4
+
+#define NEEDLE_ID_NONE (-1)
 
 typedef struct trieNeedle {
     Character *characters;
     TrieNeedleIndex length;
 } TrieNeedle;
 
+typedef struct {
+    size_t characters, length;
+    bool isValid;
+} Utf8Decoded;
+
 
 int utf8Length(unsigned char firstByte);
+bool isUtf8Continuation(unsigned char byte);
 int unicodeLength(Character unicode);
+bool unicodeIsValid(Character unicode, int length);
 
 void unicodeToUtf8(Character unicode, int length, char *output, int outputStart);
 Character utf8ToUnicode(const char *needle, int index, int length);
+Utf8Decoded utf8Decode(const char *text, size_t length, Character *output, size_t capacity);
+Utf8Decoded utf8Check(const char *text, size_t length);
+size_t utf8CountCharacters(const char *text, size_t length);
+Character unicodeFold(Character unicode);
+bool isWordCharacter(Character unicode);
+Character utf8CharacterBefore(const char *text, size_t index);
+Character utf8CharacterAt(const char *text, size_t length, size_t index);
+
+TrieNeedle *trieNeedle_fold(const TrieNeedle *needle, bool isAsciiOnly);
+
+TrieNeedle *trieNeedle_toBytes(const TrieNeedle *needle);
+size_t trieNeedle_getUtf8Length(const TrieNeedle *needle);
+
+static inline Character asciiFold(const Character character) {
+    return (u_int32_t)(character - 'A') < 26 ? character + ('a' - 'A') : character;
+}
 
 #endif
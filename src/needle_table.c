@@ -0,0 +1,95 @@
+#include <stdlib.h>
+#include <string.h>
+#include "needle_table.h"
+#include "memory.h"
+
+
+static void needleTable_reserve(NeedleTable *needleTable, NeedleTableOffset length);
+
+
+NeedleTable *createNeedleTable(const NeedleTableOffset initialSize, const NeedleId initialCount) {
+    NeedleTable *needleTable = safeAlloc(sizeof(NeedleTable), "Needle table");
+
+    needleTable->size = initialSize ?: 1;
+    needleTable->length = 0;
+    needleTable->bytes = safeAlloc(needleTable->size, "Needle table bytes");
+
+    needleTable->offsetsSize = initialCount + 1;
+    needleTable->count = 0;
+    needleTable->offsets = safeAlloc(needleTable->offsetsSize * sizeof(NeedleTableOffset), "Needle table offsets");
+    needleTable->offsets[0] = 0;
+
+    return needleTable;
+}
+
+NeedleTable *needleTable_clone(const NeedleTable *needleTable) {
+    NeedleTable *clone = createNeedleTable(needleTable->length, needleTable->count);
+
+    memcpy(clone->bytes, needleTable->bytes, needleTable->length);
+    memcpy(clone->offsets, needleTable->offsets, (needleTable->count + 1) * sizeof(NeedleTableOffset));
+    clone->length = needleTable->length;
+    clone->count = needleTable->count;
+
+    return clone;
+}
+
+static void needleTable_reserve(NeedleTable *needleTable, const NeedleTableOffset length) {
+    if (unlikely(needleTable->length + length > needleTable->size)) {
+        NeedleTableOffset newSize = needleTable->size;
+        while (newSize < needleTable->length + length) {
+            newSize = (NeedleTableOffset)calculateAllocation(newSize);
+        }
+
+        needleTable->bytes = safeRealloc(needleTable->bytes, needleTable->size, newSize, 1, "Needle table bytes");
+        needleTable->size = newSize;
+    }
+
+    if (unlikely(needleTable->count + 2 > needleTable->offsetsSize)) {
+        const NeedleId newSize = (NeedleId)calculateAllocation((size_t)needleTable->offsetsSize);
+        needleTable->offsets = safeRealloc(needleTable->offsets, needleTable->offsetsSize, newSize, sizeof(NeedleTableOffset), "Needle table offsets");
+        needleTable->offsetsSize = newSize;
+    }
+}
+
+// needles are added in order of their IDs
+void needleTable_add(NeedleTable *needleTable, const TrieNeedle *needle) {
+    NeedleTableOffset length = 0;
+    for (TrieNeedleIndex i = 0; i < needle->length; i++) {
+        length += unicodeLength(needle->characters[i]);
+    }
+
+    needleTable_reserve(needleTable, length);
+
+    for (TrieNeedleIndex i = 0; i < needle->length; i++) {
+        const int characterLength = unicodeLength(needle->characters[i]);
+        unicodeToUtf8(needle->characters[i], characterLength, needleTable->bytes, (int)needleTable->length);
+        needleTable->length += characterLength;
+    }
+
+    needleTable->offsets[++needleTable->count] = needleTable->length;
+}
+
+void needleTable_addBytes(NeedleTable *needleTable, const char *needle, const NeedleTableOffset length) {
+    needleTable_reserve(needleTable, length);
+
+    if (length) {
+        memcpy(needleTable->bytes + needleTable->length, needle, length);
+    }
+    needleTable->length += length;
+    needleTable->offsets[++needleTable->count] = needleTable->length;
+}
+
+const char *needleTable_getNeedle(const NeedleTable *needleTable, const NeedleId needleId) {
+    return needleTable->bytes + needleTable->offsets[needleId];
+}
+
+NeedleTableOffset needleTable_getLength(const NeedleTable *needleTable, const NeedleId needleId) {
+    return needleTable->offsets[needleId + 1] - needleTable->offsets[needleId];
+}
+
+void needleTable_free(NeedleTable *needleTable) {
+    safeFree(needleTable->bytes);
+    safeFree(needleTable->offsets);
+    safeFree(needleTable);
+    needleTable = NULL;
+}
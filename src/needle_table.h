@@ -0,0 +1,29 @@
+#ifndef NEEDLE_TABLE_H
+#define NEEDLE_TABLE_H
+
+#include "definitions.h"
+#include "needle.h"
+
+
+#define NEEDLE_TABLE_INIT_SIZE 64
+
+typedef u_int32_t NeedleTableOffset;
+
+// UTF8 forms of needles in one block, the needle with ID i takes bytes from offsets[i] to offsets[i + 1]
+typedef struct needleTable {
+    char *bytes;
+    NeedleTableOffset *offsets;
+    NeedleTableOffset size, length;
+    NeedleId count, offsetsSize;
+} NeedleTable;
+
+
+NeedleTable *createNeedleTable(NeedleTableOffset initialSize, NeedleId initialCount);
+NeedleTable *needleTable_clone(const NeedleTable *needleTable);
+void needleTable_add(NeedleTable *needleTable, const TrieNeedle *needle);
+void needleTable_addBytes(NeedleTable *needleTable, const char *needle, NeedleTableOffset length);
+const char *needleTable_getNeedle(const NeedleTable *needleTable, NeedleId needleId);
+NeedleTableOffset needleTable_getLength(const NeedleTable *needleTable, NeedleId needleId);
+void needleTable_free(NeedleTable *needleTable);
+
+#endif
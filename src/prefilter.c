@@ -0,0 +1,110 @@
+#include <string.h>
+#include "prefilter.h"
+#include "memory.h"
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(NO_SIMD)
+#define PREFILTER_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+
+static inline size_t prefilter_find_scalar(const Prefilter *prefilter, const unsigned char *text, size_t length, size_t index);
+#ifdef PREFILTER_SIMD_X86
+static size_t prefilter_find_ssse3(const Prefilter *prefilter, const unsigned char *text, size_t length);
+#endif
+
+
+void prefilter_reset(Prefilter *prefilter) {
+    resetMemory(prefilter, sizeof(Prefilter));
+}
+
+void prefilter_add(Prefilter *prefilter, const unsigned char byte) {
+    if (!prefilter->bytes[byte]) {
+        prefilter->bytes[byte] = 1;
+        prefilter->count++;
+    }
+}
+
+// every high nibble gets one bit (bucket), byte matches when its low and high nibble share a bit,
+// more than 8 high nibbles share buckets and produce false candidates which are verified by the byte table
+void prefilter_build(Prefilter *prefilter) {
+    int buckets[16];
+    int bucketCount = 0;
+
+    resetMemory(prefilter->low, sizeof(prefilter->low));
+    resetMemory(prefilter->high, sizeof(prefilter->high));
+
+    for (int high = 0; high < 16; high++) {
+        buckets[high] = -1;
+        for (int low = 0; low < 16; low++) {
+            if (prefilter->bytes[high << 4 | low]) {
+                if (buckets[high] < 0) {
+                    buckets[high] = bucketCount++ % 8;
+                    prefilter->high[high] = (unsigned char)(1 << buckets[high]);
+                }
+                prefilter->low[low] |= (unsigned char)(1 << buckets[high]);
+            }
+        }
+    }
+
+    prefilter->isEnabled = prefilter->count <= PREFILTER_MAX_BYTES;
+}
+
+
+static inline size_t prefilter_find_scalar(const Prefilter *prefilter, const unsigned char *text, const size_t length, size_t index) {
+    while (index < length && !prefilter->bytes[text[index]]) {
+        index++;
+    }
+
+    return index;
+}
+
+#ifdef PREFILTER_SIMD_X86
+__attribute__((target("ssse3")))
+static size_t prefilter_find_ssse3(const Prefilter *prefilter, const unsigned char *text, const size_t length) {
+    const __m128i low = _mm_loadu_si128((const __m128i *)prefilter->low);
+    const __m128i high = _mm_loadu_si128((const __m128i *)prefilter->high);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t index = 0;
+    for (; index + 16 <= length; index += 16) {
+        const __m128i chunk = _mm_loadu_si128((const __m128i *)(text + index));
+        const __m128i lowBits = _mm_shuffle_epi8(low, _mm_and_si128(chunk, nibble));
+        const __m128i highBits = _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi16(chunk, 4), nibble));
+
+        unsigned int candidates = ~(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lowBits, highBits), zero)) & 0xFFFF;
+        while (candidates) {
+            const size_t candidate = index + (size_t)__builtin_ctz(candidates);
+            if (prefilter->bytes[text[candidate]]) {
+                return candidate;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+
+    return prefilter_find_scalar(prefilter, text, length, index);
+}
+#endif
+
+// returns index of the first byte which can start a needle, or length when there is none
+size_t prefilter_find(const Prefilter *prefilter, const char *text, const size_t length) {
+    const unsigned char *bytes = (const unsigned char *)text;
+
+    if (prefilter->count == 1) {
+        for (int byte = 0; byte < 256; byte++) {
+            if (prefilter->bytes[byte]) {
+                const unsigned char *found = memchr(bytes, byte, length);
+                return found == NULL ? length : (size_t)(found - bytes);
+            }
+        }
+    }
+
+#ifdef PREFILTER_SIMD_X86
+    if (__builtin_cpu_supports("ssse3")) {
+        return prefilter_find_ssse3(prefilter, bytes, length);
+    }
+#endif
+
+    return prefilter_find_scalar(prefilter, bytes, length, 0);
+}
@@ -0,0 +1,22 @@
+#ifndef PREFILTER_H
+#define PREFILTER_H
+
+#include "definitions.h"
+
+
+#define PREFILTER_MAX_BYTES 16
+
+typedef struct {
+    bool isEnabled;
+    int count;
+    unsigned char bytes[256];
+    unsigned char low[16], high[16];
+} Prefilter;
+
+
+void prefilter_reset(Prefilter *prefilter);
+void prefilter_add(Prefilter *prefilter, unsigned char byte);
+void prefilter_build(Prefilter *prefilter);
+size_t prefilter_find(const Prefilter *prefilter, const char *text, size_t length);
+
+#endif
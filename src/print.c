@@ -48,11 +48,11 @@ void tailBuilder_print(const TailBuilder *tailBuilder) {
 
 void tail_print(const Tail *tail) {
     for (TailIndex i = 0; i < tail->size; i++) {
-        TailCell cell = tail->cells[i];
+        TailCell cell = tail_getCell(tail, i);
         printf("%d (%u): ", i, cell.length);
         if (cell.length > 0) {
-            for (TailCharIndex c = 0; c < cell.length; c++) {
-                printf("%d ", cell.chars[c]);
+            for (TailCharIndex c = 0; c < cell.length;) {
+                printf("%d ", tailCell_readCharacter(cell, &c));
             }
         } else {
             printf("empty");
@@ -101,11 +101,19 @@ void automaton_print(const Automaton *automaton) {
     }
     printf("\n");
     for (int i = 0; i < automaton->size; i++) {
+#ifdef AUTOMATON_SPLIT_CELLS
+        printf("%4d | ", automaton->fails[i]);
+#else
         printf("%4d | ", automaton->cells[i].fail);
+#endif
     }
     printf("\n");
     for (int i = 0; i < automaton->size; i++) {
+#ifdef AUTOMATON_SPLIT_CELLS
+        printf("%4d | ", automaton->outputs[i]);
+#else
         printf("%4d | ", automaton->cells[i].output);
+#endif
     }
     printf("\n\n");
 }
@@ -81,8 +81,8 @@ SocketInfo *createTCPSocketInfo(const int port) {
 }
 
 void socketInfo_free(SocketInfo *pointer) {
-    free(pointer->address);
-    free(pointer);
+    safeFree(pointer->address);
+    safeFree(pointer);
 }
 
 
@@ -95,19 +95,24 @@ static JobContext *createJobContext(EventBase *base, const ServerConfig *config)
 }
 
 static void jobContext_free(JobContext *context) {
-    free(context);
+    safeFree(context);
 }
 
 static HandlerContext *createHandlerContext(EventBase *base, void *handlerData) {
     HandlerContext *context = safeAlloc(sizeof(HandlerContext), "handler context");
     context->handlerData = handlerData;
     context->base = base;
+    context->connectionData = NULL;
+    context->connectionDataFree = NULL;
 
     return context;
 }
 
 static void handlerContext_free(HandlerContext *context) {
-    free(context);
+    if (context->connectionData != NULL) {
+        context->connectionDataFree(context->connectionData);
+    }
+    safeFree(context);
 }
 
 static EventBase *createEventBase(void) {
@@ -232,7 +237,7 @@ ServerConfig *createServerConfig(
 }
 
 void serverConfig_free(ServerConfig *config) {
-    free(config);
+    safeFree(config);
 }
 
 
@@ -247,7 +252,7 @@ Server *createServer(const ServerConfig *config, WorkerPool *pool) {
 
 void server_free(Server *server) {
     event_base_free(server->base);
-    free(server);
+    safeFree(server);
 }
 
 void server_run(Server *server, const SocketInfo *socketInfo) {
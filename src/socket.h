@@ -14,9 +14,14 @@ typedef struct event_base EventBase;
 typedef struct bufferevent BufferEvent;
 typedef struct timeval Timeval;
 
+typedef void (ConnectionDataFree)(void *connectionData);
+
+// connection data is created by the handler and freed with the connection
 typedef struct {
     void *handlerData;
     EventBase *base;
+    void *connectionData;
+    ConnectionDataFree *connectionDataFree;
 } HandlerContext;
 
 typedef struct serverConfig {
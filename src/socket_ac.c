@@ -1,4 +1,5 @@
 #include <event2/bufferevent.h>
+#include <event2/buffer.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,13 +15,16 @@ static void safeRead(BufferEvent *bufferEvent, void *data, size_t size);
 static void safeWrite(BufferEvent *bufferEvent, const void *data, size_t size);
 
 static SearchMode readSearchMode(BufferEvent *bufferEvent);
-static Needle *readNeedle(BufferEvent *bufferEvent);
+static size_t readNeedleLength(BufferEvent *bufferEvent);
+static const Needle *readNeedle(BufferEvent *bufferEvent, size_t needleLength);
 
 static inline void writeNeedle(BufferEvent *bufferEvent, const Occurrence *occurrence);
 static inline void writeUserDataSize(BufferEvent *bufferEvent, const Occurrence *occurrence);
 static inline void writeUserDataValue(BufferEvent *bufferEvent, const Occurrence *occurrence);
 static inline void writeNoOccurrence(BufferEvent *bufferEvent);
-static void writeOccurrence(BufferEvent *bufferEvent, SearchMode mode, Occurrence * restrict occurrence);
+static inline void writeCount(BufferEvent *bufferEvent, size_t count);
+static void writeOccurrence(BufferEvent *bufferEvent, SearchMode mode, const Occurrence * restrict occurrence);
+static void connectionData_free(void *connectionData);
 
 
 HandlerData *createHandlerData(const Automaton *automaton, const Tail *tail, const UserDataList *userDataList) {
@@ -33,7 +37,7 @@ HandlerData *createHandlerData(const Automaton *automaton, const Tail *tail, con
 }
 
 void handlerData_free(HandlerData *data) {
-    free(data);
+    safeFree(data);
     data = NULL;
 }
 
@@ -52,20 +56,29 @@ static void safeWrite(BufferEvent *bufferEvent, const void *data, size_t size) {
 
 
 static SearchMode readSearchMode(BufferEvent *bufferEvent) {
-    SearchMode mode;
-    safeRead(bufferEvent, &mode, 1);
-    return mode;
+    unsigned char mode = 0;
+    safeRead(bufferEvent, &mode, sizeof(mode));
+    return (SearchMode)mode;
 }
 
-static Needle *readNeedle(BufferEvent *bufferEvent) {
+static size_t readNeedleLength(BufferEvent *bufferEvent) {
     int32_t needleLength = 0;
     safeRead(bufferEvent, &needleLength, sizeof(needleLength));
 
-    Needle *characters = safeAlloc(sizeof(char) * (needleLength + 1), "AC search needle");
-    safeRead(bufferEvent, characters, (size_t)needleLength);
+    if (unlikely(0 > needleLength)) {
+        error("needle length can not be negative");
+    }
+
+    return (size_t)needleLength;
+}
+
+static const Needle *readNeedle(BufferEvent *bufferEvent, const size_t needleLength) {
+    struct evbuffer *input = bufferevent_get_input(bufferEvent);
+    if (unlikely(evbuffer_get_length(input) < needleLength)) {
+        error("can not read data from buffer");
+    }
 
-    characters[needleLength] = '\0';
-    return characters;
+    return (const Needle *)evbuffer_pullup(input, (ev_ssize_t)needleLength);
 }
 
 
@@ -87,21 +100,26 @@ static inline void writeNoOccurrence(BufferEvent *bufferEvent) {
     safeWrite(bufferEvent, (const void *) &(UserDataSize){-1}, sizeof(UserDataSize));
 }
 
-static void writeOccurrence(BufferEvent *bufferEvent, const SearchMode mode, Occurrence * restrict occurrence) {
+// count is saturated to fit the fixed 4 bytes
+static inline void writeCount(BufferEvent *bufferEvent, const size_t count) {
+    const int32_t value = count > INT32_MAX ? INT32_MAX : (int32_t)count;
+    safeWrite(bufferEvent, &value, sizeof(value));
+}
+
+// occurrences are owned by the search context of the connection
+static void writeOccurrence(BufferEvent *bufferEvent, const SearchMode mode, const Occurrence * restrict occurrence) {
     if (NULL == occurrence) {
         writeNoOccurrence(bufferEvent);
         return;
     }
     writeUserDataSize(bufferEvent, occurrence);
 
-    Occurrence *prev;
     do {
         if (mode & SEARCH_MODE_USER_DATA) {
             writeUserDataValue(bufferEvent, occurrence);
         }
         if (mode & SEARCH_MODE_NEEDLE) {
             writeNeedle(bufferEvent, occurrence);
-            free(occurrence->needle.needle);
         }
         if (!(mode & SEARCH_MODE_FIRST)) {
             if (NULL == occurrence->next) {
@@ -111,22 +129,41 @@ static void writeOccurrence(BufferEvent *bufferEvent, const SearchMode mode, Occ
             }
         }
 
-        prev = occurrence;
         occurrence = occurrence->next;
-
-        occurrence_free(prev);
     } while (NULL != occurrence);
 }
 
+static void connectionData_free(void *connectionData) {
+    searchContext_free((SearchContext *)connectionData);
+}
+
 void ahoCorasickHandler(BufferEvent *bufferEvent, void *handlerContext) {
-    const HandlerContext *context = (HandlerContext *)handlerContext;
+    HandlerContext *context = (HandlerContext *)handlerContext;
     const HandlerData *data = (HandlerData *)context->handlerData;
 
-    const SearchMode mode = readSearchMode(bufferEvent);
-    Needle *needle = readNeedle(bufferEvent);
+    SearchMode mode = readSearchMode(bufferEvent);
+    const size_t needleLength = readNeedleLength(bufferEvent);
+    const Needle *needle = readNeedle(bufferEvent, needleLength);
+
+    // needles of the dictionary with the needle table are written without copying
+    if (mode & SEARCH_MODE_NEEDLE && data->automaton->needleTable != NULL) {
+        mode |= SEARCH_MODE_NEEDLE_REFERENCE;
+    }
+
+    if (mode & SEARCH_MODE_COUNT) {
+        writeCount(bufferEvent, automaton_searchCount(data->automaton, data->tail, data->userDataList, needle, needleLength, mode));
+    } else {
+        // each connection reuses memory of its search context, it is reset after every response
+        if (NULL == context->connectionData) {
+            context->connectionData = createSearchContext(0);
+            context->connectionDataFree = connectionData_free;
+        }
 
-    Occurrence *occurrence = automaton_search(data->automaton, data->tail, data->userDataList, needle, mode);
-    writeOccurrence(bufferEvent, mode, occurrence);
+        SearchContext *searchContext = (SearchContext *)context->connectionData;
+        const Occurrence *occurrence = automaton_searchInContext(data->automaton, data->tail, data->userDataList, needle, needleLength, mode, searchContext);
+        writeOccurrence(bufferEvent, mode, occurrence);
+        searchContext_reset(searchContext);
+    }
 
-    free(needle);
+    evbuffer_drain(bufferevent_get_input(bufferEvent), needleLength);
 }
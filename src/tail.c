@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "dat.h"
 #include "tail.h"
 #include "memory.h"
@@ -9,6 +10,13 @@ static void tailBuilder_poolReallocate(TailBuilder *tailBuilder, TailIndex newSi
 static void tailBuilder_poolInit(TailBuilder *tailBuilder, TailIndex fromIndex, TailIndex toIndex);
 static void characters_free(Character *chars);
 static TailIndex tailBuilder_findLastFilled(const TailBuilder *tailBuilder);
+static u_int32_t tailBuilder_hash(TailCharIndex length, const Character *chars);
+static TailIndex *tailBuilder_getBucket(const TailBuilder *tailBuilder, TailCharIndex length, const Character *chars);
+static TailIndex tailBuilder_findSame(const TailBuilder *tailBuilder, TailCharIndex length, const Character *chars);
+static void tailBuilder_bucketsLink(TailBuilder *tailBuilder, TailIndex index);
+static void tailBuilder_bucketsInsert(TailBuilder *tailBuilder, TailIndex index);
+static void tailBuilder_bucketsRemove(TailBuilder *tailBuilder, TailIndex index);
+static void tailBuilder_bucketsReallocate(TailBuilder *tailBuilder, TailIndex newSize);
 
 
 Character *allocateCharacters(const TailCharIndex size) {
@@ -16,15 +24,28 @@ Character *allocateCharacters(const TailCharIndex size) {
 }
 
 static void characters_free(Character *chars) {
-    free(chars);
+    safeFree(chars);
     chars = NULL;
 }
 
 
-Tail *createTail(const size_t size) {
+// returns the end of written bytes
+TailCharIndex tail_encodeCharacters(char *output, TailCharIndex outputStart, const TailCharIndex length, const Character *chars) {
+    for (TailCharIndex i = 0; i < length; i++) {
+        const int characterLength = unicodeLength(chars[i]);
+        unicodeToUtf8(chars[i], characterLength, output, (int)outputStart);
+        outputStart += characterLength;
+    }
+
+    return outputStart;
+}
+
+Tail *createTail(const size_t size, const size_t length) {
     Tail *tail = safeAlloc(sizeof(Tail), "Tail");
     tail->size = (TailIndex)size;
-    tail->cells = safeAlloc(sizeof(TailCell) * tail->size, "Tail cells");
+    tail->length = (TailCharIndex)length;
+    tail->offsets = safeAlloc(sizeof(TailCharIndex) * (tail->size + 1), "Tail offsets");
+    tail->bytes = safeAlloc(length, "Tail bytes");
 
     return tail;
 }
@@ -32,35 +53,44 @@ Tail *createTail(const size_t size) {
 Tail *createTailFromBuilder(const TailBuilder *tailBuilder) {
     const TailIndex lastFilled = tailBuilder_findLastFilled(tailBuilder);
 
-    Tail *tail = createTail(lastFilled + 1);
+    size_t length = 0;
+    for (TailIndex i = 0; i <= lastFilled; i++) {
+        for (TailCharIndex c = 0; c < tailBuilder->cells[i].length; c++) {
+            length += unicodeLength(tailBuilder->cells[i].chars[c]);
+        }
+    }
+
+    if (unlikely(length > UINT32_MAX)) {
+        error("tail reached maximum size");
+    }
 
+    Tail *tail = createTail(lastFilled + 1, length);
+
+    TailCharIndex offset = 0;
     for (TailIndex i = 0; i < tail->size; i++) {
-        tail->cells[i].length = tailBuilder->cells[i].length;
-        tail->cells[i].chars = tailBuilder->cells[i].chars;
+        tail->offsets[i] = offset;
+        offset = tail_encodeCharacters(tail->bytes, offset, tailBuilder->cells[i].length, tailBuilder->cells[i].chars);
     }
+    tail->offsets[tail->size] = offset;
 
     return tail;
 }
 
 TailCell tail_getCell(const Tail *tail, const TailIndex index) {
-    return tail->cells[index];
+    return (TailCell) {tail->bytes + tail->offsets[index], tail->offsets[index + 1] - tail->offsets[index]};
 }
 
 void tail_free(Tail *tail) {
-    for (TailIndex i = 1; i < tail->size; i++) {
-        if (likely(tail->cells[i].chars != NULL)) {
-            characters_free(tail->cells[i].chars);
-        }
-    }
-    free(tail->cells);
-    free(tail);
+    safeFree(tail->bytes);
+    safeFree(tail->offsets);
+    safeFree(tail);
     tail = NULL;
 }
 
 
 static void tailBuilder_poolInit(TailBuilder *tailBuilder, const TailIndex fromIndex, const TailIndex toIndex) {
     for (TrieIndex i = fromIndex; i < toIndex; i++) {
-        tailBuilder->cells[i] = (TailBuilderCell) {NULL, 0, i + 1};
+        tailBuilder->cells[i] = (TailBuilderCell) {NULL, 0, i + 1, 0, 0};
     }
 }
 
@@ -73,6 +103,8 @@ TailBuilder *createTailBuilder(const size_t size) {
 
     tailBuilder->size = (TailIndex)size;
     tailBuilder->cells = safeAlloc(tailBuilder->size * sizeof(TailBuilderCell), "TailBuilder cells");
+    tailBuilder->buckets = NULL;
+    tailBuilder->bucketsSize = tailBuilder->bucketsFilled = 0;
 
     tailBuilder_poolInit(tailBuilder, 0, tailBuilder->size);
 
@@ -85,13 +117,110 @@ void tailBuilder_freeCharacters(TailBuilder *tailBuilder) {
     for (TailIndex i = 1; i < tailBuilder->size; i++) {
         if (tailBuilder->cells[i].chars != NULL) {
             characters_free(tailBuilder->cells[i].chars);
+            tailBuilder->cells[i].chars = NULL;
         }
     }
+
+    // buckets can not compare suffixes without characters
+    safeFree(tailBuilder->buckets);
+    tailBuilder->buckets = NULL;
+    tailBuilder->bucketsSize = tailBuilder->bucketsFilled = 0;
+}
+
+// identical suffixes inserted later share one cell, cells already in the builder are shared too
+void tailBuilder_useDeduplication(TailBuilder *tailBuilder) {
+    if (tailBuilder->buckets != NULL) {
+        return;
+    }
+
+    TailIndex filled = 0;
+    for (TailIndex i = 1; i < tailBuilder->size; i++) {
+        filled += tailBuilder->cells[i].chars != NULL;
+    }
+
+    TailIndex size = TAIL_BUILDER_BUCKETS_INIT_SIZE;
+    while (size < filled) {
+        size *= 2;
+    }
+
+    tailBuilder_bucketsReallocate(tailBuilder, size);
 }
 
+// FNV-1a over characters
+static u_int32_t tailBuilder_hash(const TailCharIndex length, const Character *chars) {
+    u_int32_t hash = 2166136261u;
+    for (TailCharIndex i = 0; i < length; i++) {
+        hash = (hash ^ (u_int32_t)chars[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static TailIndex *tailBuilder_getBucket(const TailBuilder *tailBuilder, const TailCharIndex length, const Character *chars) {
+    return &tailBuilder->buckets[tailBuilder_hash(length, chars) & (u_int32_t)(tailBuilder->bucketsSize - 1)];
+}
+
+static TailIndex tailBuilder_findSame(const TailBuilder *tailBuilder, const TailCharIndex length, const Character *chars) {
+    TailIndex index = *tailBuilder_getBucket(tailBuilder, length, chars);
+    while (index) {
+        const TailBuilderCell cell = tailBuilder->cells[index];
+        if (cell.length == length && !memcmp(cell.chars, chars, length * sizeof(Character))) {
+            return index;
+        }
+        index = cell.nextSame;
+    }
+
+    return 0;
+}
+
+static void tailBuilder_bucketsLink(TailBuilder *tailBuilder, const TailIndex index) {
+    TailBuilderCell *cell = &tailBuilder->cells[index];
+    TailIndex *bucket = tailBuilder_getBucket(tailBuilder, cell->length, cell->chars);
+    cell->nextSame = *bucket;
+    *bucket = index;
+    tailBuilder->bucketsFilled++;
+}
+
+static void tailBuilder_bucketsInsert(TailBuilder *tailBuilder, const TailIndex index) {
+    tailBuilder_bucketsLink(tailBuilder, index);
+
+    if (unlikely(tailBuilder->bucketsFilled > tailBuilder->bucketsSize)) {
+        tailBuilder_bucketsReallocate(tailBuilder, tailBuilder->bucketsSize * 2);
+    }
+}
+
+static void tailBuilder_bucketsRemove(TailBuilder *tailBuilder, const TailIndex index) {
+    const TailBuilderCell cell = tailBuilder->cells[index];
+    TailIndex *link = tailBuilder_getBucket(tailBuilder, cell.length, cell.chars);
+    while (*link != index) {
+        link = &tailBuilder->cells[*link].nextSame;
+    }
+
+    *link = cell.nextSame;
+    tailBuilder->bucketsFilled--;
+}
+
+// size of buckets is a power of two, cells are chained again by their hashes
+static void tailBuilder_bucketsReallocate(TailBuilder *tailBuilder, const TailIndex newSize) {
+    safeFree(tailBuilder->buckets);
+    tailBuilder->buckets = safeAlloc((size_t)newSize * sizeof(TailIndex), "TailBuilder buckets");
+    resetMemory(tailBuilder->buckets, (size_t)newSize * sizeof(TailIndex));
+    tailBuilder->bucketsSize = newSize;
+    tailBuilder->bucketsFilled = 0;
+
+    for (TailIndex i = 1; i < tailBuilder->size; i++) {
+        if (tailBuilder->cells[i].chars != NULL) {
+            tailBuilder_bucketsLink(tailBuilder, i);
+        }
+    }
+}
+
+// characters are owned by the builder, the tail has own copy
 void tailBuilder_free(TailBuilder *tailBuilder) {
-    free(tailBuilder->cells);
-    free(tailBuilder);
+    tailBuilder_freeCharacters(tailBuilder);
+    safeFree(tailBuilder->buckets);
+    safeFree(tailBuilder->cells);
+    safeFree(tailBuilder);
     tailBuilder = NULL;
 }
 
@@ -120,11 +249,22 @@ void tailBuilder_poolReallocate(TailBuilder *tailBuilder, const TailIndex newSiz
     tailBuilder->size = newSize;
 }
 
+// shared cell is freed when the last trie state stops using it
 void tailBuilder_freeCell(TailBuilder *tail, const TailIndex index) {
-    free(tail->cells[index].chars);
+    if (tail->cells[index].references > 1) {
+        tail->cells[index].references--;
+        return;
+    }
+
+    if (tail->buckets != NULL) {
+        tailBuilder_bucketsRemove(tail, index);
+    }
+
+    safeFree(tail->cells[index].chars);
 
     tail->cells[index].chars = NULL;
     tail->cells[index].length = 0;
+    tail->cells[index].references = 0;
 
     if (tail->cells[0].nextFree > index) {
         tail->cells[index].nextFree = tail->cells[0].nextFree;
@@ -140,7 +280,18 @@ void tailBuilder_freeCell(TailBuilder *tail, const TailIndex index) {
     }
 }
 
+// the builder takes ownership of the string, it is freed when the same suffix is already stored
 TailIndex tailBuilder_insertChars(TailBuilder *tail, const TailCharIndex length, Character *string) {
+    if (tail->buckets != NULL) {
+        const TailIndex same = tailBuilder_findSame(tail, length, string);
+        if (same) {
+            characters_free(string);
+            tail->cells[same].references++;
+
+            return same;
+        }
+    }
+
     TailIndex index = tail->cells[0].nextFree;
 
     if (index == 0) {
@@ -153,6 +304,11 @@ TailIndex tailBuilder_insertChars(TailBuilder *tail, const TailCharIndex length,
     tail->cells[index].length = length;
     tail->cells[index].chars = string;
     tail->cells[index].nextFree = 0;
+    tail->cells[index].references = 1;
+
+    if (tail->buckets != NULL) {
+        tailBuilder_bucketsInsert(tail, index);
+    }
 
     return index;
 }
@@ -7,29 +7,41 @@
 typedef int32_t TailIndex;
 typedef u_int32_t TailCharIndex;
 
+// tail stores characters (symbols of the trie) encoded as UTF-8, length is in bytes
 typedef struct {
-    Character *chars;
+    const char *bytes;
     TailCharIndex length;
 } TailCell;
 
+// bytes of all cells are kept in one pool, cell i is between offsets i and i + 1
 typedef struct tail {
     TailIndex size;
-    TailCell *cells;
+    TailCharIndex length;
+    TailCharIndex *offsets;
+    char *bytes;
 } Tail;
 
+#define TAIL_BUILDER_BUCKETS_INIT_SIZE 64
+
 typedef struct {
     Character *chars;
     TailCharIndex length;
     TailIndex nextFree;
+    TailIndex nextSame; // next cell in the same bucket of shared suffixes
+    u_int32_t references; // number of trie states ending with the cell
 } TailBuilderCell;
 
+// with deduplication each bucket is a chain of cells with the same hash, buckets are NULL without it
 typedef struct tailBuilder {
     TailBuilderCell *cells;
     TailIndex size;
+    TailIndex *buckets;
+    TailIndex bucketsSize, bucketsFilled;
 } TailBuilder;
 
 
 void tailBuilder_freeCharacters(TailBuilder *tailBuilder);
+void tailBuilder_useDeduplication(TailBuilder *tailBuilder);
 void tailBuilder_freeCell(TailBuilder *tailBuilder, TailIndex index);
 void tailBuilder_minimize(TailBuilder *tailBuilder);
 TailIndex tailBuilder_insertChars(TailBuilder *tailBuilder, TailCharIndex length, Character *string);
@@ -37,5 +49,19 @@ TailIndex tailBuilder_insertChars(TailBuilder *tailBuilder, TailCharIndex length
 TailCell tail_getCell(const Tail *tail, TailIndex index);
 
 Character *allocateCharacters(TailCharIndex size);
+TailCharIndex tail_encodeCharacters(char *output, TailCharIndex outputStart, TailCharIndex length, const Character *chars);
+
+// each symbol is one UTF-8 character, which is one position of the search (a byte for byte alphabet)
+static inline size_t tailCell_countSymbols(const TailCell tailCell) {
+    return utf8CountCharacters(tailCell.bytes, tailCell.length);
+}
+
+static inline Character tailCell_readCharacter(const TailCell tailCell, TailCharIndex *index) {
+    const int length = utf8Length((unsigned char)tailCell.bytes[*index]);
+    const Character character = utf8ToUnicode(tailCell.bytes, (int)*index, length);
+    *index += length;
+
+    return character;
+}
 
 #endif
@@ -51,12 +51,12 @@ Job *createJob(void *userData) {
 }
 
 static void job_free(Job *job) {
-    free(job);
+    safeFree(job);
 }
 
 
 static void worker_free(Worker *worker) {
-    free(worker);
+    safeFree(worker);
     worker = NULL;
 }
 
@@ -108,6 +108,7 @@ static void *worker_function(void *userData) {
             } else {
                 worker->pool->jobFirst = job->nextJob;
             }
+            worker->pool->runningJobs++;
         }
 
         safeMutexUnlock(&worker->pool->jobMutex);
@@ -122,6 +123,15 @@ static void *worker_function(void *userData) {
 
         worker->pool->jobHandler(job->userData);
         job_free(job);
+
+        safeMutexLock(&worker->pool->jobMutex);
+        worker->pool->runningJobs--;
+        if (NULL == worker->pool->jobFirst && 0 == worker->pool->runningJobs) {
+            if (unlikely(0 != pthread_cond_broadcast(&worker->pool->idleCondition))) {
+                error("can not thread broadcast");
+            }
+        }
+        safeMutexUnlock(&worker->pool->jobMutex);
     }
 
     return NULL;
@@ -149,9 +159,11 @@ WorkerPool *createWorkerPool(int count, JobHandler *handler) {
     pool->jobHandler = handler;
     pool->jobFirst = NULL;
     pool->jobLast = NULL;
+    pool->runningJobs = 0;
 
     memcpy(&pool->jobMutex, &initializerMutex, sizeof(initializerMutex));
     memcpy(&pool->jobCondition, &initializerCondition, sizeof(initializerCondition));
+    memcpy(&pool->idleCondition, &initializerCondition, sizeof(initializerCondition));
 
     Worker *next;
     Worker *last = pool->workerList;
@@ -213,7 +225,7 @@ void workerPool_free(WorkerPool *pool) {
         job = nextJob;
     }
 
-    free(pool);
+    safeFree(pool);
     pool = NULL;
 }
 
@@ -233,3 +245,14 @@ void workerPool_addJob(WorkerPool *pool, Job * restrict job) {
     }
     safeMutexUnlock(&pool->jobMutex);
 }
+
+// waits until all added jobs are done, workers keep running
+void workerPool_drain(WorkerPool *pool) {
+    safeMutexLock(&pool->jobMutex);
+    while (NULL != pool->jobFirst || 0 != pool->runningJobs) {
+        if (unlikely(0 != pthread_cond_wait(&pool->idleCondition, &pool->jobMutex))) {
+            error("can not wait for condition");
+        }
+    }
+    safeMutexUnlock(&pool->jobMutex);
+}
@@ -1,6 +1,7 @@
 #ifndef THREAD_H
 #define THREAD_H
 
+#include <pthread.h>
 #include "../include/thread.h"
 #include "definitions.h"
 
@@ -14,8 +15,10 @@ typedef struct workerPool {
     JobHandler *jobHandler;
     pthread_mutex_t jobMutex;
     pthread_cond_t jobCondition;
+    pthread_cond_t idleCondition;
     Job *jobFirst;
     Job *jobLast;
+    int runningJobs;
 } WorkerPool;
 
 typedef struct worker {
@@ -29,5 +32,6 @@ typedef struct worker {
 Job *createJob(void *userData);
 void workerPool_join(WorkerPool *pool);
 void workerPool_addJob(WorkerPool *pool, Job *job);
+void workerPool_drain(WorkerPool *pool);
 
 #endif
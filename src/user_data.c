@@ -31,5 +31,6 @@ UserData userDataList_get(const UserDataList *userDataList, const UserDataIndex
 }
 
 void userDataList_free(UserDataList *userDataList) {
-    free(userDataList);
+    safeFree(userDataList->cells);
+    safeFree(userDataList);
 }
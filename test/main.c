@@ -0,0 +1,715 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "../include/ac.h"
+#include "../include/dat.h"
+#include "../include/needle.h"
+#include "../include/tail.h"
+#include "../include/list.h"
+#include "../include/file.h"
+#include "../include/user_data.h"
+
+
+// more than 16 start bytes, so the prefilter is not used
+static const char *startNeedles[] = {
+        "az", "bz", "cz", "dz", "ez", "fz", "gz", "hz", "iz", "jz",
+        "kz", "lz", "mz", "nz", "oz", "pz", "qz", "rz", "sz", "tz",
+};
+static const int startNeedlesLength = sizeof(startNeedles) / sizeof(startNeedles[0]);
+
+// one start byte, so the search skips to it
+static const char *oneNeedle[] = {"az"};
+
+
+static int fails = 0;
+
+static void check(const bool condition, const char *message) {
+    if (!condition) {
+        fprintf(stderr, "failed: %s\n", message);
+        fails++;
+    }
+}
+
+static struct automaton *createAutomaton(const char **needles, const int needlesLength) {
+    struct trieOptions *options = createTrieOptions(false, false, 4);
+    struct trie *trie = createTrie(options, NULL, NULL, 4);
+
+    for (int i = 0; i < needlesLength; i++) {
+        struct trieNeedle *trieNeedle = createTrieNeedle(needles[i]);
+        trie_addNeedle(trie, trieNeedle);
+        trieNeedle_free(trieNeedle);
+    }
+
+    struct list *list = createList(10);
+    struct automaton *automaton = createAutomaton_BFS(trie, list, false);
+
+    trieOptions_free(options);
+    trie_free(trie);
+    list_free(list);
+
+    return automaton;
+}
+
+// occurrences are written as "start-end " to the context
+static _Bool appendOffsets(const struct occurrence *occurrence, void *context) {
+    char *output = (char *)context;
+    sprintf(output + strlen(output), "%zu-%zu ", occurrence_getStart(occurrence), occurrence_getEnd(occurrence));
+    return true;
+}
+
+// occurrences are written as "start-end:needle ID:needle " to the context
+static void writeNeedle(const struct occurrence *occurrence, char *output) {
+    const char *needle = occurrence_getNeedle(occurrence);
+    sprintf(
+            output + strlen(output),
+            "%zu-%zu:%d:%.*s ",
+            occurrence_getStart(occurrence),
+            occurrence_getEnd(occurrence),
+            occurrence_getNeedleId(occurrence),
+            needle ? occurrence_getNeedleLength(occurrence) : 0,
+            needle ? needle : ""
+    );
+}
+
+// the needle is owned by the handler
+static _Bool appendNeedleIds(const struct occurrence *occurrence, void *context) {
+    char *needle = occurrence_getNeedle(occurrence);
+    writeNeedle(occurrence, (char *)context);
+    if (needle) {
+        needle_free(needle);
+    }
+    return true;
+}
+
+// the needle points to the needle table of the automaton
+static _Bool appendNeedleReferences(const struct occurrence *occurrence, void *context) {
+    writeNeedle(occurrence, (char *)context);
+    return true;
+}
+
+static void searchOffsets(const struct automaton *automaton, const char *text, const size_t length, const enum searchMode mode, char *output) {
+    output[0] = '\0';
+    automaton_searchEach(automaton, NULL, NULL, text, length, mode, appendOffsets, output);
+}
+
+
+static void searchStreamOffsets(const struct automaton *automaton, const char *text, const size_t length, const size_t chunkSize, char *output) {
+    struct searchState *searchState = createSearchState(automaton, NULL, NULL, 0);
+    output[0] = '\0';
+
+    for (size_t index = 0; index < length; index += chunkSize) {
+        const size_t left = length - index;
+        if (!searchState_feed(searchState, text + index, left < chunkSize ? left : chunkSize, appendOffsets, output)) {
+            break;
+        }
+    }
+
+    searchState_finish(searchState);
+    searchState_free(searchState);
+}
+
+
+static const char *invalidTexts[][2] = {
+            {"\xf7\xbf\xbf\xbf", ""}, // above Unicode range
+            {"\xc1\xa1z az", ""}, // overlong 'a'
+            {"az\xc1\xa1z az", "0-2 "},
+            {"az\xed\xa0\x80 az", "0-2 "}, // surrogate
+            {"az\xf4\x90\x80\x80 az", "0-2 "},
+            {"\xe2\x82\xac az", "4-6 "},
+            {"\xff az", ""},
+            {"\xe2 az", ""}, // incomplete character
+};
+#define INVALID_TEXTS_LENGTH (int)(sizeof(invalidTexts) / sizeof(invalidTexts[0]))
+
+static void testInvalidTextBatch(const struct automaton *automaton) {
+    const char *texts[INVALID_TEXTS_LENGTH];
+    size_t lengths[INVALID_TEXTS_LENGTH];
+    char outputs[INVALID_TEXTS_LENGTH][256];
+    void *contexts[INVALID_TEXTS_LENGTH];
+
+    for (int i = 0; i < INVALID_TEXTS_LENGTH; i++) {
+        texts[i] = invalidTexts[i][0];
+        lengths[i] = strlen(invalidTexts[i][0]);
+        outputs[i][0] = '\0';
+        contexts[i] = outputs[i];
+    }
+
+    automaton_searchBatchEach(automaton, NULL, NULL, texts, lengths, INVALID_TEXTS_LENGTH, 0, appendOffsets, contexts);
+
+    for (int i = 0; i < INVALID_TEXTS_LENGTH; i++) {
+        check(0 == strcmp(outputs[i], invalidTexts[i][1]), "invalid UTF8 stops the batch search");
+    }
+}
+
+static void testInvalidText(void) {
+    char output[256];
+
+    const enum searchMode modes[] = {0, SEARCH_MODE_LEFTMOST_LONGEST};
+
+    // with and without skipping to the start bytes
+    struct automaton *automata[] = {
+            createAutomaton(startNeedles, startNeedlesLength),
+            createAutomaton(oneNeedle, 1),
+    };
+
+    for (size_t a = 0; a < sizeof(automata) / sizeof(automata[0]); a++) {
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+            for (int i = 0; i < INVALID_TEXTS_LENGTH; i++) {
+                searchOffsets(automata[a], invalidTexts[i][0], strlen(invalidTexts[i][0]), modes[m], output);
+                check(0 == strcmp(output, invalidTexts[i][1]), "invalid UTF8 stops the search");
+            }
+        }
+        testInvalidTextBatch(automata[a]);
+        automaton_free(automata[a]);
+    }
+
+    check(NULL == createTrieNeedle("\xc1\xa1"), "overlong needle is not valid");
+    check(NULL == createTrieNeedle("\xed\xa0\x80"), "surrogate needle is not valid");
+    check(NULL == createTrieNeedle("\xf7\xbf\xbf\xbf"), "needle above Unicode range is not valid");
+}
+
+// stream fed by chunks of any size has the same occurrences as one search of the whole text
+static void testStreamInvalidText(void) {
+    char output[256], streamOutput[256];
+
+    struct automaton *automaton = createAutomaton(startNeedles, startNeedlesLength);
+    for (int i = 0; i < INVALID_TEXTS_LENGTH; i++) {
+        const size_t length = strlen(invalidTexts[i][0]);
+        searchOffsets(automaton, invalidTexts[i][0], length, 0, output);
+
+        for (size_t chunkSize = 1; chunkSize <= length; chunkSize++) {
+            searchStreamOffsets(automaton, invalidTexts[i][0], length, chunkSize, streamOutput);
+            check(0 == strcmp(output, streamOutput), "stream has the same occurrences as the search");
+        }
+    }
+    automaton_free(automaton);
+}
+
+
+// with the tail, bulk construction can put "dd" into the tail of "d", while insertion gives it own states
+static const char *bulkNeedles[] = {
+        "cbc", "cdcb", "dd", "bdcd", "cbc", "he", "she", "his", "hers", "\xe2\x82\xac", "a\xe2\x82\xac", "hershey",
+};
+static const int bulkNeedlesLength = sizeof(bulkNeedles) / sizeof(bulkNeedles[0]);
+
+static const char *bulkTexts[] = {
+        "bccddcac", "ushershey", "cdcbdcdd", "a\xe2\x82\xac\xe2\x82\xac his", "",
+};
+static const int bulkTextsLength = sizeof(bulkTexts) / sizeof(bulkTexts[0]);
+
+// bulk construction gives the same needle IDs and occurrences as insertion in order of the input,
+// text is searched without the tail or with the unfolded one, the compact tail is used for exact lookups
+static void testBulkConstruction(void) {
+    const enum searchMode modes[] = {0, SEARCH_MODE_NEEDLE, SEARCH_MODE_LEFTMOST_LONGEST, SEARCH_MODE_LEFTMOST_FIRST};
+    char output[1024], bulkOutput[1024];
+
+    struct trieNeedle *needles[sizeof(bulkNeedles) / sizeof(bulkNeedles[0])];
+    int32_t needleIds[sizeof(bulkNeedles) / sizeof(bulkNeedles[0])];
+    for (int i = 0; i < bulkNeedlesLength; i++) {
+        needles[i] = createTrieNeedle(bulkNeedles[i]);
+    }
+
+    for (int useTail = 0; useTail <= 1; useTail++) {
+        struct trieOptions *options = createTrieOptions(useTail, false, 4);
+        struct tailBuilder *tailBuilder = useTail ? createTailBuilder(4) : NULL;
+        struct tailBuilder *bulkTailBuilder = useTail ? createTailBuilder(4) : NULL;
+
+        struct trie *trie = createTrie(options, tailBuilder, NULL, 4);
+        struct trie *bulkTrie = createTrieFromNeedles(
+                options, bulkTailBuilder, NULL, 4, needles, NULL, bulkNeedlesLength, needleIds
+        );
+        for (int i = 0; i < bulkNeedlesLength; i++) {
+            check(trie_addNeedle(trie, needles[i]) == needleIds[i], "bulk needle ID is the same as after insertion");
+        }
+
+        struct list *list = createList(10);
+        struct automaton *automaton = createAutomaton_BFS(trie, list, useTail);
+        struct automaton *bulkAutomaton = createAutomaton_BFS(bulkTrie, list, useTail);
+
+        for (int t = 0; t < bulkTextsLength; t++) {
+            const size_t length = strlen(bulkTexts[t]);
+            for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+                output[0] = bulkOutput[0] = '\0';
+                automaton_searchEach(automaton, NULL, NULL, bulkTexts[t], length, modes[m], appendNeedleIds, output);
+                automaton_searchEach(bulkAutomaton, NULL, NULL, bulkTexts[t], length, modes[m], appendNeedleIds, bulkOutput);
+                check(0 == strcmp(output, bulkOutput), "bulk trie has the same occurrences in text");
+            }
+        }
+        automaton_free(automaton);
+        automaton_free(bulkAutomaton);
+
+        if (useTail) {
+            automaton = createAutomaton_BFS(trie, list, false);
+            bulkAutomaton = createAutomaton_BFS(bulkTrie, list, false);
+            struct tail *tail = createTailFromBuilder(tailBuilder);
+            struct tail *bulkTail = createTailFromBuilder(bulkTailBuilder);
+
+            for (int i = 0; i < bulkNeedlesLength + bulkTextsLength; i++) {
+                const char *text = i < bulkNeedlesLength ? bulkNeedles[i] : bulkTexts[i - bulkNeedlesLength];
+                output[0] = bulkOutput[0] = '\0';
+                automaton_searchEach(automaton, tail, NULL, text, strlen(text), SEARCH_MODE_EXACT, appendNeedleIds, output);
+                automaton_searchEach(bulkAutomaton, bulkTail, NULL, text, strlen(text), SEARCH_MODE_EXACT, appendNeedleIds, bulkOutput);
+                check(0 == strcmp(output, bulkOutput), "bulk trie with the tail has the same exact lookups");
+                check(i >= bulkNeedlesLength || '\0' != bulkOutput[0], "bulk trie with the tail finds each needle");
+            }
+
+            automaton_free(automaton);
+            automaton_free(bulkAutomaton);
+            tail_free(tail);
+            tail_free(bulkTail);
+        }
+
+        list_free(list);
+        trie_free(trie);
+        trie_free(bulkTrie);
+        trieOptions_free(options);
+        if (useTail) {
+            tailBuilder_free(tailBuilder);
+            tailBuilder_free(bulkTailBuilder);
+        }
+    }
+
+    for (int i = 0; i < bulkNeedlesLength; i++) {
+        trieNeedle_free(needles[i]);
+    }
+}
+
+
+static const char *fileNeedles[] = {
+        "he", "she", "his", "hers", "caf\xc3\xa9", "na\xc3\xafve", "\xc3\x84rger", "\xce\xbb\xcf\x8c\xce\xb3\xce\xbf\xcf\x82",
+};
+static const int fileNeedlesLength = sizeof(fileNeedles) / sizeof(fileNeedles[0]);
+
+static const char *fileTexts[] = {
+        "ushers caf\xc3\xa9 na\xc3\xafve his", "\xc3\xa4rger \xce\x9b\xce\x8c\xce\x93\xce\x9f\xce\xa3 HERS", "naive", "",
+};
+static const int fileTextsLength = sizeof(fileTexts) / sizeof(fileTexts[0]);
+
+#define FILE_PATH "ac_dat_test.bin"
+
+// every text and needle is searched by both automata in each mode, the outputs must be the same
+static void compareSearch(
+        const struct automaton *automaton,
+        const struct tail *tail,
+        const struct automaton *loadedAutomaton,
+        const struct tail *loadedTail,
+        const enum searchMode *modes,
+        const size_t modesLength,
+        const char *message
+) {
+    char output[1024], loadedOutput[1024];
+
+    for (int i = 0; i < fileNeedlesLength + fileTextsLength; i++) {
+        const char *text = i < fileNeedlesLength ? fileNeedles[i] : fileTexts[i - fileNeedlesLength];
+        for (size_t m = 0; m < modesLength; m++) {
+            SearchHandler *handler = (modes[m] & SEARCH_MODE_NEEDLE_REFERENCE) == SEARCH_MODE_NEEDLE_REFERENCE
+                ? appendNeedleReferences
+                : appendNeedleIds;
+            output[0] = loadedOutput[0] = '\0';
+            automaton_searchEach(automaton, tail, NULL, text, strlen(text), modes[m], handler, output);
+            automaton_searchEach(loadedAutomaton, loadedTail, NULL, text, strlen(text), modes[m], handler, loadedOutput);
+            check(0 == strcmp(output, loadedOutput), message);
+        }
+    }
+}
+
+// stored automaton with the tail, needle table, alphabet and transition table (and the one with unfolded tail)
+// is loaded with the same occurrences
+static void testFileRoundTrip(void) {
+    const enum searchMode modes[] = {
+            0, SEARCH_MODE_NEEDLE, SEARCH_MODE_NEEDLE_REFERENCE, SEARCH_MODE_EXACT | SEARCH_MODE_NEEDLE,
+            SEARCH_MODE_LEFTMOST_LONGEST | SEARCH_MODE_NEEDLE, SEARCH_MODE_WHOLE_WORD,
+    };
+    const size_t modesLength = sizeof(modes) / sizeof(modes[0]);
+
+    for (int useCaseFolding = 0; useCaseFolding <= 1; useCaseFolding++) {
+        struct trieOptions *options = createTrieOptions(true, true, 4);
+        trieOptions_setDenseAlphabet(options, true);
+        trieOptions_setCaseFolding(options, useCaseFolding);
+        struct tailBuilder *tailBuilder = createTailBuilder(4);
+        struct userDataList *userDataList = createUserDataList(4);
+        struct trie *trie = createTrie(options, tailBuilder, userDataList, 4);
+
+        for (int i = 0; i < fileNeedlesLength; i++) {
+            struct trieNeedle *trieNeedle = createTrieNeedle(fileNeedles[i]);
+            trie_addNeedle(trie, trieNeedle);
+            trieNeedle_free(trieNeedle);
+        }
+
+        struct list *list = createList(10);
+        struct tail *tail = createTailFromBuilder(tailBuilder);
+        struct automaton *automaton = createAutomaton_BFS(trie, list, false);
+        struct automaton *unfolded = createAutomaton_BFS(trie, list, true);
+        automaton_buildNeedleTable(automaton, tail);
+        automaton_buildTransitionTable(automaton);
+        automaton_buildNeedleTable(unfolded, NULL);
+        automaton_buildTransitionTable(unfolded);
+
+        file_store(FILE_PATH, automaton, tail, userDataList);
+        struct fileData fileData = file_load(FILE_PATH);
+        compareSearch(automaton, tail, fileData.automaton, fileData.tail, modes, modesLength, "loaded automaton with the tail has the same occurrences");
+        automaton_free(fileData.automaton);
+        tail_free(fileData.tail);
+        userDataList_free(fileData.userDataList);
+
+        file_store(FILE_PATH, unfolded, NULL, userDataList);
+        fileData = file_load(FILE_PATH);
+        compareSearch(unfolded, NULL, fileData.automaton, NULL, modes, modesLength, "loaded automaton with unfolded tail has the same occurrences");
+        automaton_free(fileData.automaton);
+        userDataList_free(fileData.userDataList);
+        remove(FILE_PATH);
+
+        automaton_free(automaton);
+        automaton_free(unfolded);
+        tail_free(tail);
+        list_free(list);
+        trie_free(trie);
+        tailBuilder_free(tailBuilder);
+        userDataList_free(userDataList);
+        trieOptions_free(options);
+    }
+}
+
+// the file was stored before the tail kept UTF8 bytes (without the extended header), its tail has characters,
+// the needles are "he", "she", "his", "hers", "café" and "naïve" inserted with the tail, user data and no needle IDs
+static void testFileLegacyTail(const char *path) {
+    static const char *lookups[][2] = {
+            {"he", "0-2:-1:he "},
+            {"hers", "0-4:-1:hers "},
+            {"caf\xc3\xa9", "0-5:-1:caf\xc3\xa9 "},
+            {"na\xc3\xafve", "0-6:-1:na\xc3\xafve "},
+            {"naive", ""},
+            {"her", ""},
+    };
+    char output[256];
+
+    struct fileData fileData = file_load(path);
+    for (size_t i = 0; i < sizeof(lookups) / sizeof(lookups[0]); i++) {
+        output[0] = '\0';
+        automaton_searchEach(
+                fileData.automaton, fileData.tail, fileData.userDataList, lookups[i][0], strlen(lookups[i][0]),
+                SEARCH_MODE_EXACT | SEARCH_MODE_NEEDLE, appendNeedleIds, output
+        );
+        check(0 == strcmp(output, lookups[i][1]), "needle is found in the file with the legacy tail");
+    }
+
+    automaton_free(fileData.automaton);
+    tail_free(fileData.tail);
+    userDataList_free(fileData.userDataList);
+}
+
+
+static const char *parallelNeedles[] = {
+        "he", "she", "hers", "\xe2\x82\xac" "uro", "caf\xc3\xa9", "lorem ipsum dolor", "m i", "ur",
+};
+static const int parallelNeedlesLength = sizeof(parallelNeedles) / sizeof(parallelNeedles[0]);
+static const char *parallelWords[] = {"lorem", "ipsum", "caf\xc3\xa9", "\xe2\x82\xac", "hers", "x", "dolor", "\xc3\xa1"};
+
+#define PARALLEL_TEXT_LENGTH (4 * 65536 + 1000)
+#define PARALLEL_PLACED "lorem ipsum dolor \xe2\x82\xacuro ushers"
+#define PARALLEL_PLACED_EURO_END 21
+
+// each occurrence is written as "start-end:characters:needle ID:needle " and freed
+static size_t writeOccurrences(struct occurrence *occurrence, char *output) {
+    size_t length = 0, count = 0;
+    output[0] = '\0';
+
+    while (occurrence) {
+        struct occurrence *next = occurrence_getNext(occurrence);
+        char *needle = occurrence_getNeedle(occurrence);
+        length += (size_t)sprintf(
+                output + length,
+                "%zu-%zu:%zu-%zu:%d:%.*s ",
+                occurrence_getStart(occurrence),
+                occurrence_getEnd(occurrence),
+                occurrence_getCharacterStart(occurrence),
+                occurrence_getCharacterEnd(occurrence),
+                occurrence_getNeedleId(occurrence),
+                needle ? occurrence_getNeedleLength(occurrence) : 0,
+                needle ? needle : ""
+        );
+        if (needle) {
+            needle_free(needle);
+        }
+        occurrence_free(occurrence);
+        occurrence = next;
+        count++;
+    }
+
+    return count;
+}
+
+// characters cut by the needle written over the text are replaced by spaces, so the text stays valid UTF8
+static void placeNeedle(char *text, const size_t length, const size_t position, const char *needle) {
+    for (size_t i = position; i > 0 && (text[i] & 0xC0) == 0x80; i--) {
+        text[i - 1] = ' ';
+    }
+
+    const size_t needleLength = strlen(needle);
+    memcpy(text + position, needle, needleLength);
+    for (size_t i = position + needleLength; i < length && (text[i] & 0xC0) == 0x80; i++) {
+        text[i] = ' ';
+    }
+}
+
+static char *createParallelText(void) {
+    char *text = malloc(PARALLEL_TEXT_LENGTH + 1);
+    size_t length = 0;
+    unsigned int seed = 7;
+
+    while (length < PARALLEL_TEXT_LENGTH) {
+        seed = seed * 1103515245 + 12345;
+        const char *word = parallelWords[(seed >> 16) % (sizeof(parallelWords) / sizeof(parallelWords[0]))];
+        const size_t wordLength = strlen(word);
+        if (length + wordLength + 1 > PARALLEL_TEXT_LENGTH) {
+            break;
+        }
+        memcpy(text + length, word, wordLength);
+        length += wordLength;
+        text[length++] = ' ';
+    }
+    memset(text + length, ' ', PARALLEL_TEXT_LENGTH - length);
+    text[PARALLEL_TEXT_LENGTH] = '\0';
+
+    // needles cross the split of the text into 2, 3 and 4 chunks at different positions,
+    // some splits fall right behind "€", so "€uro" with the tail is reported before the split and ends after it
+    for (size_t count = 2; count <= 4; count++) {
+        for (size_t i = 1; i < count; i++) {
+            const size_t split = PARALLEL_TEXT_LENGTH / count * i;
+            placeNeedle(text, PARALLEL_TEXT_LENGTH, split - ((count + i) % 2 ? PARALLEL_PLACED_EURO_END : 10 + count + i), PARALLEL_PLACED);
+        }
+    }
+
+    return text;
+}
+
+// text larger than two chunks is searched by more threads with the same occurrences as by one search,
+// with the tail the occurrence is reported (and merged) where the tail starts
+static void testParallelSearch(void) {
+    const enum searchMode modes[] = {0, SEARCH_MODE_NEEDLE, SEARCH_MODE_FIRST, SEARCH_MODE_WHOLE_WORD | SEARCH_MODE_NEEDLE};
+    const size_t outputSize = 64 * PARALLEL_TEXT_LENGTH;
+    char *output = malloc(outputSize), *parallelOutput = malloc(outputSize);
+    char *text = createParallelText();
+
+    for (int useTail = 0; useTail <= 1; useTail++) {
+        struct trieOptions *options = createTrieOptions(useTail, false, 4);
+        struct tailBuilder *tailBuilder = useTail ? createTailBuilder(4) : NULL;
+        struct trie *trie = createTrie(options, tailBuilder, NULL, 4);
+        for (int i = 0; i < parallelNeedlesLength; i++) {
+            struct trieNeedle *trieNeedle = createTrieNeedle(parallelNeedles[i]);
+            trie_addNeedle(trie, trieNeedle);
+            trieNeedle_free(trieNeedle);
+        }
+
+        struct list *list = createList(10);
+        struct automaton *automaton = createAutomaton_BFS(trie, list, false);
+        struct tail *tail = useTail ? createTailFromBuilder(tailBuilder) : NULL;
+
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+            const size_t count = writeOccurrences(
+                    automaton_searchWithLength(automaton, tail, NULL, text, PARALLEL_TEXT_LENGTH, modes[m]), output
+            );
+            check(count > 0, "text for the parallel search has occurrences");
+
+            for (int threadCount = 2; threadCount <= 4; threadCount++) {
+                writeOccurrences(
+                        automaton_searchParallel(automaton, tail, NULL, text, PARALLEL_TEXT_LENGTH, modes[m], threadCount),
+                        parallelOutput
+                );
+                check(0 == strcmp(output, parallelOutput), "parallel search has the same occurrences as one search");
+            }
+        }
+
+        automaton_free(automaton);
+        if (useTail) {
+            tail_free(tail);
+            tailBuilder_free(tailBuilder);
+        }
+        list_free(list);
+        trie_free(trie);
+        trieOptions_free(options);
+    }
+
+    free(text);
+    free(output);
+    free(parallelOutput);
+}
+
+
+typedef struct {
+    const char *needles[4];
+    bool useByteAlphabet;
+    const char *text, *expected;
+} FoldingCase;
+
+static const FoldingCase foldingCases[] = {
+        // Latin-1, Greek and Cyrillic letters are folded, the needle is returned in its dictionary form
+        {
+                {"Stra\xc3\x9f" "e", "\xce\xa3\xce\x9f\xce\xa6\xce\x99\xce\x91", "\xd0\x9c\xd0\xbe\xd1\x81\xd0\xba\xd0\xb2\xd0\xb0", "\xc3\x89" "clair"},
+                false,
+                "STRA\xc3\x9f" "E, \xcf\x83\xce\xbf\xcf\x86\xce\xb9\xce\xb1; \xd0\x9c\xd0\x9e\xd0\xa1\xd0\x9a\xd0\x92\xd0\x90 \xc3\xa9" "CLAIR strasse",
+                "0-7:0:Stra\xc3\x9f" "e 9-19:1:\xce\xa3\xce\x9f\xce\xa6\xce\x99\xce\x91 "
+                "21-33:2:\xd0\x9c\xd0\xbe\xd1\x81\xd0\xba\xd0\xb2\xd0\xb0 34-41:3:\xc3\x89" "clair ",
+        },
+        // with byte alphabet only ASCII letters are folded, so "é" does not match "É"
+        {{"\xc3\x89" "clair", "ABC"}, true, "\xc3\xa9" "clair \xc3\x89" "CLAIR abc", "8-15:0:\xc3\x89" "clair 16-19:1:ABC "},
+        // one start byte enables the prefilter, it has the first byte of the capital letter as well
+        {{"\xcf\x83\xce\xbf\xcf\x86\xce\xb9\xce\xb1"}, false, "xx \xce\xa3\xce\x9f\xce\xa6\xce\x99\xce\x91", "3-13:0:\xcf\x83\xce\xbf\xcf\x86\xce\xb9\xce\xb1 "},
+        {{"abc"}, true, "xx ABC", "3-6:0:abc "},
+};
+
+// text is folded while searched, occurrences point to the original text
+static void testCaseFolding(void) {
+    char output[256];
+
+    for (size_t c = 0; c < sizeof(foldingCases) / sizeof(foldingCases[0]); c++) {
+        const FoldingCase *foldingCase = &foldingCases[c];
+        struct trieOptions *options = createTrieOptions(false, false, 4);
+        trieOptions_setCaseFolding(options, true);
+        trieOptions_setByteAlphabet(options, foldingCase->useByteAlphabet);
+        struct trie *trie = createTrie(options, NULL, NULL, 4);
+
+        for (int i = 0; i < 4 && foldingCase->needles[i]; i++) {
+            struct trieNeedle *trieNeedle = createTrieNeedle(foldingCase->needles[i]);
+            trie_addNeedle(trie, trieNeedle);
+            trieNeedle_free(trieNeedle);
+        }
+
+        struct list *list = createList(10);
+        struct automaton *automaton = createAutomaton_BFS(trie, list, false);
+
+        output[0] = '\0';
+        automaton_searchEach(automaton, NULL, NULL, foldingCase->text, strlen(foldingCase->text), SEARCH_MODE_NEEDLE, appendNeedleIds, output);
+        check(0 == strcmp(output, foldingCase->expected), "folded text has the occurrences of the needles");
+
+        automaton_free(automaton);
+        list_free(list);
+        trie_free(trie);
+        trieOptions_free(options);
+    }
+}
+
+
+static const char *wordNeedles[] = {"he", "hers", "caf\xc3\xa9", "he is", "\xe6\x97\xa5\xe6\x9c\xac"};
+static const int wordNeedlesLength = sizeof(wordNeedles) / sizeof(wordNeedles[0]);
+
+// matches inside words, next to digits or underscore are rejected, CJK punctuation is not a word character
+static void testWholeWord(void) {
+    static const char *text = "he hers ushers caf\xc3\xa9, caf\xc3\xa9s he_ (he) 5he he is\xe3\x80\x82\xe6\x97\xa5\xe6\x9c\xac\xe3\x80\x82";
+    static const char *expected[] = {
+            "0-2:0: 3-7:1: 15-20:2: 34-36:0: 42-44:0: 42-47:3: 50-56:4: ",
+            "0-2:0: 3-7:1: 15-20:2: 34-36:0: 42-47:3: 50-56:4: ",
+    };
+    const enum searchMode modes[] = {SEARCH_MODE_WHOLE_WORD, SEARCH_MODE_WHOLE_WORD | SEARCH_MODE_LEFTMOST_LONGEST};
+    char output[256];
+
+    for (int useByteAlphabet = 0; useByteAlphabet <= 1; useByteAlphabet++) {
+        struct trieOptions *options = createTrieOptions(false, false, 4);
+        trieOptions_setByteAlphabet(options, useByteAlphabet);
+        struct trie *trie = createTrie(options, NULL, NULL, 4);
+
+        for (int i = 0; i < wordNeedlesLength; i++) {
+            struct trieNeedle *trieNeedle = createTrieNeedle(wordNeedles[i]);
+            trie_addNeedle(trie, trieNeedle);
+            trieNeedle_free(trieNeedle);
+        }
+
+        struct list *list = createList(10);
+        struct automaton *automaton = createAutomaton_BFS(trie, list, false);
+
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+            output[0] = '\0';
+            automaton_searchEach(automaton, NULL, NULL, text, strlen(text), modes[m], appendNeedleIds, output);
+            check(0 == strcmp(output, expected[m]), "only whole words are found");
+        }
+
+        automaton_free(automaton);
+        list_free(list);
+        trie_free(trie);
+        trieOptions_free(options);
+    }
+}
+
+
+// occurrences of the list are counted and freed
+static size_t countOccurrences(struct occurrence *occurrence) {
+    size_t count = 0;
+    while (occurrence) {
+        struct occurrence *next = occurrence_getNext(occurrence);
+        occurrence_free(occurrence);
+        occurrence = next;
+        count++;
+    }
+
+    return count;
+}
+
+// counting and existence check give the same number of occurrences as the list in every mode
+static void testCount(void) {
+    static const char *texts[] = {
+            "ushers caf\xc3\xa9 na\xc3\xafve his", "he hers ushers caf\xc3\xa9, caf\xc3\xa9s he_ (he) 5he he is", "hers", "he", "bccddcac", "",
+    };
+    const enum searchMode modes[] = {
+            0, SEARCH_MODE_FIRST, SEARCH_MODE_EXACT, SEARCH_MODE_WHOLE_WORD, SEARCH_MODE_LEFTMOST_LONGEST, SEARCH_MODE_LEFTMOST_FIRST,
+    };
+
+    for (int useTail = 0; useTail <= 1; useTail++) {
+        struct trieOptions *options = createTrieOptions(useTail, false, 4);
+        struct tailBuilder *tailBuilder = useTail ? createTailBuilder(4) : NULL;
+        struct trie *trie = createTrie(options, tailBuilder, NULL, 4);
+
+        for (int i = 0; i < bulkNeedlesLength; i++) {
+            struct trieNeedle *trieNeedle = createTrieNeedle(bulkNeedles[i]);
+            trie_addNeedle(trie, trieNeedle);
+            trieNeedle_free(trieNeedle);
+        }
+
+        struct list *list = createList(10);
+        struct automaton *automaton = createAutomaton_BFS(trie, list, false);
+        struct tail *tail = useTail ? createTailFromBuilder(tailBuilder) : NULL;
+
+        for (size_t t = 0; t < sizeof(texts) / sizeof(texts[0]); t++) {
+            const size_t length = strlen(texts[t]);
+            for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+                const size_t count = countOccurrences(automaton_searchWithLength(automaton, tail, NULL, texts[t], length, modes[m]));
+                check(count == automaton_searchCount(automaton, tail, NULL, texts[t], length, modes[m]), "count is the number of occurrences");
+                check((count > 0) == automaton_searchExists(automaton, tail, NULL, texts[t], length, modes[m]), "occurrence exists when found");
+            }
+        }
+
+        automaton_free(automaton);
+        if (useTail) {
+            tail_free(tail);
+            tailBuilder_free(tailBuilder);
+        }
+        list_free(list);
+        trie_free(trie);
+        trieOptions_free(options);
+    }
+}
+
+
+int main(const int argc, const char **argv) {
+    testInvalidText();
+    testStreamInvalidText();
+    testBulkConstruction();
+    testFileRoundTrip();
+    testParallelSearch();
+    testCaseFolding();
+    testWholeWord();
+    testCount();
+
+    if (argc > 1) {
+        testFileLegacyTail(argv[1]);
+    } else {
+        check(false, "path to the file with the legacy tail is given");
+    }
+
+    if (fails) {
+        fprintf(stderr, "%d checks failed\n", fails);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}